@@ -27,6 +27,7 @@
 #include <TopAbs_ShapeEnum.hxx>
 
 #include "FakeTopoShape.h"
+#include "TopoNamingLog.h"
 #include <iostream>
 #include <iomanip>
 #include <stdexcept>
@@ -100,26 +101,26 @@ void TopoShape::UpdateBox(const BoxData& BData)
 	TData.OldShape = this->GetShape();
 	TData.NewShape = mkBox.Shape();
 
-	TopoDS_Face origFace, newFace;
-	std::vector<TopoDS_Face> newFaces = this->GetBoxFacesVector(mkBox);
+	// Look up the box nodes once, rather than formatting and parsing a tag per face
+	TDF_Label boxNode = this->_TopoNamer.GetLabel("0:2");
+	TDF_Label origFacesNode = this->_TopoNamer.GetLabel("0:2:1:1");
 
-	for (int i = 0; i <= 5; i++)
+	// The children of 0:2:1:1 hold the original faces. GetLatestShape returns the latest
+	// modification of each one in the Topological History
+	std::vector<TopoDS_Face> origFaces;
+	for (int i = 1; i <= TopoNamingHelper::CountChildren(origFacesNode); i++)
 	{
-		// Tag 0:2:1:1:i+1 should hold the original face. GetLatestShape returns the latest
-		// modification of this face in the Topological History
-		std::ostringstream tag;
-		tag << "0:2:1:1:" << (i + 1);
-		TopoDS_Shape origShape = _TopoNamer.GetLatestShape(tag.str());
-		origFace = TopoDS::Face(origShape);
-		newFace = newFaces[i];
-
-		if (!_TopoNamer.CompareTwoFaceTopologies(origFace, newFace))
-		{
-			TData.ModifiedFaces.push_back({ origFace, newFace });
-		}
+		TDF_Label origFaceNode = this->_TopoNamer.GetNodeLabel(origFacesNode, i);
+		origFaces.push_back(TopoDS::Face(_TopoNamer.GetLatestShape(origFaceNode)));
 	}
 
-	this->_TopoNamer.TrackModifiedShape("0:2", TData.NewShape, TData, "Modified Box Node");
+	// DiffShapes pairs the faces up itself, so the order of the faces doesn't matter
+	TopoData diff = this->_TopoNamer.DiffShapes(origFaces, this->GetBoxFacesVector(mkBox));
+	TData.ModifiedFaces = diff.ModifiedFaces;
+	TData.GeneratedFaces = diff.GeneratedFaces;
+	TData.DeletedFaces = diff.DeletedFaces;
+
+	this->_TopoNamer.TrackModifiedShape(boxNode, TData.NewShape, TData, "Modified Box Node");
 	this->SetShape(mkBox.Shape());
 }
 
@@ -133,9 +134,9 @@ void TopoShape::CreateFilletBaseShape(const TopoShape& BaseShape)
 	// Collect and track appropriate data
 	TopoData TData;
 
-	TopTools_IndexedMapOfShape faces;
 	// TODO need to handle possible seam edges
-	TopExp::MapShapes(BaseShape.GetShape(), TopAbs_FACE, faces);
+	std::shared_ptr<const TopologyIndex> baseIndex = this->_TopoNamer.GetTopologyIndex(BaseShape.GetShape());
+	const TopTools_IndexedMapOfShape& faces = baseIndex->Faces();
 	for (int i = 1; i <= faces.Extent(); i++)
 	{
 		TopoDS_Face face = TopoDS::Face(faces.FindKey(i));
@@ -143,7 +144,7 @@ void TopoShape::CreateFilletBaseShape(const TopoShape& BaseShape)
 	}
 
 	TData.NewShape = BaseShape.GetShape();
-	this->_TopoNamer.TrackGeneratedShape(this->_TopoNamer.GetNode(2), TData.NewShape, TData, "Generated Base Shape");
+	this->_TopoNamer.TrackGeneratedShape(this->_TopoNamer.GetNodeLabel(2), TData.NewShape, TData, "Generated Base Shape");
 	this->SetShape(BaseShape.GetShape());
 }
 
@@ -153,10 +154,10 @@ BRepFilletAPI_MakeFillet TopoShape::CreateFillet(const TopoShape& BaseShape, con
 	// calling TopoShape::selectEdge(s) by the caller.
 	BRepFilletAPI_MakeFillet mkFillet(BaseShape.GetShape());
 
-	for (auto&& FData : FDatas)
+	std::vector<TopoDS_Shape> edges = this->SolveFilletEdges(FDatas);
+	for (size_t i = 0; i < FDatas.size(); i++)
 	{
-		TopoDS_Edge edge = this->_TopoNamer.GetSelectedEdge(FData.edgeTag);
-		mkFillet.Add(FData.radius1, FData.radius2, edge);
+		mkFillet.Add(FDatas[i].radius1, FDatas[i].radius2, TopoDS::Edge(edges[i]));
 	}
 
 	mkFillet.Build();
@@ -167,8 +168,8 @@ BRepFilletAPI_MakeFillet TopoShape::CreateFillet(const TopoShape& BaseShape, con
 	//this->_TopoNamer.TrackGeneratedShape(this->_TopoNamer.GetNode(3), newShape, TFData, "Filleted Shape");	
 	this->_TopoNamer.TrackFilletOperation(BaseShape.GetShape(), newShape, mkFillet);
 	this->SetShape(newShape);
-	std::clog << "-----Dumping topohistory after tracking fillet op" << std::endl;
-	std::clog << this->_TopoNamer.DeepDump2() << std::endl;
+	TN_LOG_DEBUG(TopoNamingLog::Tracking, "-----Dumping topohistory after tracking fillet op");
+	TN_LOG_DEBUG(TopoNamingLog::Tracking, this->_TopoNamer.DeepDump2());
 	return mkFillet;
 }
 
@@ -183,10 +184,10 @@ void TopoShape::UpdateFillet(const TopoShape& BaseShape, const std::vector<Fille
 	{
 		BRepFilletAPI_MakeFillet mkFillet(BaseShape.GetShape());
 
-		for (auto&& FData : FDatas)
+		std::vector<TopoDS_Shape> edges = this->SolveFilletEdges(FDatas);
+		for (size_t i = 0; i < FDatas.size(); i++)
 		{
-			TopoDS_Edge edge = this->_TopoNamer.GetSelectedEdge(FData.edgeTag);
-			mkFillet.Add(FData.radius1, FData.radius2, edge);
+			mkFillet.Add(FDatas[i].radius1, FDatas[i].radius2, TopoDS::Edge(edges[i]));
 		}
 
 		mkFillet.Build();
@@ -198,7 +199,7 @@ void TopoShape::UpdateFillet(const TopoShape& BaseShape, const std::vector<Fille
 	}
 	catch (Standard_Failure sf)
 	{
-		std::cout << "\x1B[31mFilleting error: " << sf << "\033[0m" << std::endl;
+		TN_LOG_ERROR(TopoNamingLog::Tracking, "Filleting error: " << sf);
 		return;
 	}
 
@@ -213,8 +214,8 @@ void TopoShape::UpdateFillet(const TopoShape& BaseShape, const std::vector<Fille
 
 bool TopoShape::SelectEdge(const int edgeID, SelectionElement& outSelection)
 {
-	TopTools_IndexedMapOfShape listOfEdges;
-	TopExp::MapShapes(_Shape, TopAbs_EDGE, listOfEdges);
+	std::shared_ptr<const TopologyIndex> shapeIndex = this->_TopoNamer.GetTopologyIndex(_Shape);
+	const TopTools_IndexedMapOfShape& listOfEdges = shapeIndex->Edges();
 
 	try
 	{
@@ -225,7 +226,7 @@ bool TopoShape::SelectEdge(const int edgeID, SelectionElement& outSelection)
 	}
 	catch (Standard_Failure sf)
 	{
-		std::cout << "Error: " << sf << std::endl;
+		TN_LOG_ERROR(TopoNamingLog::Selection, "Error: " << sf);
 		return false;
 	}
 
@@ -234,8 +235,8 @@ bool TopoShape::SelectEdge(const int edgeID, SelectionElement& outSelection)
 
 std::string TopoShape::SelectEdge(const int edgeID, TNaming_Selector& selector, TDF_Label& selectionLabel)
 {
-	TopTools_IndexedMapOfShape listOfEdges;
-	TopExp::MapShapes(_Shape, TopAbs_EDGE, listOfEdges);
+	std::shared_ptr<const TopologyIndex> shapeIndex = this->_TopoNamer.GetTopologyIndex(_Shape);
+	const TopTools_IndexedMapOfShape& listOfEdges = shapeIndex->Edges();
 
 	// Get the specific edge, I hope
 	const TopoDS_Edge& anEdge = TopoDS::Edge(listOfEdges.FindKey(edgeID));
@@ -244,6 +245,27 @@ std::string TopoShape::SelectEdge(const int edgeID, TNaming_Selector& selector,
 	return edgeLabel;
 }
 
+std::vector<std::string> TopoShape::SelectEdges(const std::vector<int>& edgeIDs)
+{
+	std::shared_ptr<const TopologyIndex> shapeIndex = this->_TopoNamer.GetTopologyIndex(_Shape);
+	const TopTools_IndexedMapOfShape& listOfEdges = shapeIndex->Edges();
+
+	std::vector<TopoDS_Shape> edges;
+	edges.reserve(edgeIDs.size());
+	for (auto&& edgeID : edgeIDs)
+	{
+		edges.push_back(listOfEdges.FindKey(edgeID));
+	}
+
+	std::vector<std::string> edgeTags;
+	edgeTags.reserve(edgeIDs.size());
+	for (auto&& edgeLabel : this->_TopoNamer.SelectBatch(edges, _Shape))
+	{
+		edgeTags.push_back(TopoNamingHelper::GetTag(edgeLabel));
+	}
+	return edgeTags;
+}
+
 //-------------------- Private Methods--------------------
 
 std::vector<TopoDS_Face> TopoShape::GetBoxFacesVector(BRepPrimAPI_MakeBox mkBox) const
@@ -264,15 +286,26 @@ TopTools_ListOfShape TopoShape::GetBoxFaces(BRepPrimAPI_MakeBox mkBox) const
 	return OutFaces;
 }
 
+std::vector<TopoDS_Shape> TopoShape::SolveFilletEdges(const std::vector<FilletElement>& FDatas) const
+{
+	std::vector<TDF_Label> edgeLabels;
+	edgeLabels.reserve(FDatas.size());
+	for (auto&& FData : FDatas)
+	{
+		edgeLabels.push_back(this->_TopoNamer.GetLabel(FData.edgeTag));
+	}
+	return this->_TopoNamer.SolveSelections(edgeLabels);
+}
+
 FilletData TopoShape::GetFilletData(const TopoShape& BaseShape, BRepFilletAPI_MakeFillet& mkFillet) const
 {
 	// Get the data we need for topo history
 	FilletData TFData;
 
-	TopTools_IndexedMapOfShape faces;
 	// TODO need to handle possible seam edges
 	// TODO need to pull BaseShape from topo tree
-	TopExp::MapShapes(BaseShape.GetShape(), TopAbs_FACE, faces);
+	std::shared_ptr<const TopologyIndex> baseIndex = this->_TopoNamer.GetTopologyIndex(BaseShape.GetShape());
+	const TopTools_IndexedMapOfShape& faces = baseIndex->Faces();
 	for (int i = 1; i <= faces.Extent(); i++)
 	{
 		TopoDS_Face face = TopoDS::Face(faces.FindKey(i));
@@ -288,8 +321,7 @@ FilletData TopoShape::GetFilletData(const TopoShape& BaseShape, BRepFilletAPI_Ma
 		}
 	}
 
-	TopTools_IndexedMapOfShape edges;
-	TopExp::MapShapes(BaseShape.GetShape(), TopAbs_EDGE, edges);
+	const TopTools_IndexedMapOfShape& edges = baseIndex->Edges();
 	for (int i = 1; i <= edges.Extent(); i++)
 	{
 		TopoDS_Edge edge = TopoDS::Edge(edges.FindKey(i));
@@ -302,8 +334,7 @@ FilletData TopoShape::GetFilletData(const TopoShape& BaseShape, BRepFilletAPI_Ma
 		}
 	}
 
-	TopTools_IndexedMapOfShape vertexes;
-	TopExp::MapShapes(BaseShape.GetShape(), TopAbs_VERTEX, vertexes);
+	const TopTools_IndexedMapOfShape& vertexes = baseIndex->Vertices();
 	for (int i = 1; i <= vertexes.Extent(); i++)
 	{
 		TopoDS_Vertex vertex = TopoDS::Vertex(vertexes.FindKey(i));
@@ -84,6 +84,8 @@ public:
 
 	bool SelectEdge(const int edgeID, SelectionElement& outSelection);
 	std::string SelectEdge(const int edgeID, TNaming_Selector& selector, TDF_Label& selectionLabel);	
+	// Select all of the edges at once, returns the selection tag for each edgeID
+	std::vector<std::string> SelectEdges(const std::vector<int>& edgeIDs);
 
 private:
 	TopoNamingHelper _TopoNamer;
@@ -92,5 +94,7 @@ private:
 	std::vector<TopoDS_Face> GetBoxFacesVector(BRepPrimAPI_MakeBox mkBox) const;
 	TopTools_ListOfShape GetBoxFaces(BRepPrimAPI_MakeBox mkBox) const;
 	FilletData GetFilletData(const TopoShape& BaseShape, BRepFilletAPI_MakeFillet& mkFillet) const;
+	// Solve the selected edge of every FilletElement in one go
+	std::vector<TopoDS_Shape> SolveFilletEdges(const std::vector<FilletElement>& FDatas) const;
 };
 #endif /* ifndef FAKE_TOPO_SHAPE_H */
@@ -0,0 +1,525 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+#include <BRep_Tool.hxx>
+#include <Adaptor3d_HSurface.hxx>
+#include <BRepAdaptor_Curve.hxx>
+#include <BRepAdaptor_Surface.hxx>
+#include <BRepTools.hxx>
+#include <BRepGProp_Face.hxx>
+#include <GCPnts_AbscissaPoint.hxx>
+#include <Geom2d_Curve.hxx>
+#include <Geom_Curve.hxx>
+#include <GeomAdaptor_Curve.hxx>
+#include <Geom_BSplineSurface.hxx>
+#include <Geom_BezierSurface.hxx>
+#include <Precision.hxx>
+#include <TDataStd_RealArray.hxx>
+#include <TopExp.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopoDS_Vertex.hxx>
+#include <TopTools_IndexedDataMapOfShapeListOfShape.hxx>
+#include <TopTools_ListIteratorOfListOfShape.hxx>
+#include <gp.hxx>
+#include <gp_Cone.hxx>
+#include <gp_Cylinder.hxx>
+#include <gp_Pln.hxx>
+#include <gp_Sphere.hxx>
+#include <gp_Torus.hxx>
+#include <gp_Pnt2d.hxx>
+
+#include "GeometricSignature.h"
+#include "TopologyIndex.h"
+#include "ShapeBVH.h"
+
+namespace
+{
+	// CurveType, three points, Length and two normals
+	const int SignatureSize = 1 + 3 * 3 + 1 + 2 * 3;
+
+	void StorePoint(const Handle(TDataStd_RealArray)& anArray, const int& start, const gp_XYZ& aPoint)
+	{
+		anArray->SetValue(start, aPoint.X());
+		anArray->SetValue(start + 1, aPoint.Y());
+		anArray->SetValue(start + 2, aPoint.Z());
+	}
+
+	gp_XYZ RetrievePoint(const Handle(TDataStd_RealArray)& anArray, const int& start)
+	{
+		return gp_XYZ(anArray->Value(start), anArray->Value(start + 1), anArray->Value(start + 2));
+	}
+
+	void QuantizePoint(const gp_Pnt& aPoint, long long* out)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			out[i] = std::llround(aPoint.Coord(i + 1) / Precision::Confusion());
+		}
+	}
+
+	long long QuantizeLength(const double& aLength)
+	{
+		return std::llround(aLength / Precision::Confusion());
+	}
+
+	// +1 or -1, whichever makes the first significant component of aDir positive
+	double CanonicalSign(const gp_Dir& aDir)
+	{
+		for (int i = 1; i <= 3; i++)
+		{
+			if (std::abs(aDir.Coord(i)) > Precision::Angular())
+			{
+				return aDir.Coord(i) > 0. ? 1. : -1.;
+			}
+		}
+		return 1.;
+	}
+
+	// Flip aDir to its canonical sign, then quantize it
+	void QuantizeDirection(const gp_Dir& aDir, long long* out)
+	{
+		const double sign = CanonicalSign(aDir);
+		for (int i = 0; i < 3; i++)
+		{
+			out[i] = std::llround(sign * aDir.Coord(i + 1) / Precision::Angular());
+		}
+	}
+
+	// The point on the line through aPoint along aDir that is closest to the origin. Any
+	// point on an axis would do, this one just doesn't depend on which was stored.
+	gp_Pnt AxisPoint(const gp_Pnt& aPoint, const gp_Dir& aDir)
+	{
+		const gp_XYZ p = aPoint.XYZ();
+		return gp_Pnt(p - aDir.XYZ() * p.Dot(aDir.XYZ()));
+	}
+
+	void HashCombine(std::size_t& seed, const long long& value)
+	{
+		seed ^= std::hash<long long>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+
+	template <typename Surface>
+	std::size_t HashPoles(const Handle(Surface)& aSurface)
+	{
+		std::size_t seed = 0;
+		long long coords[3];
+		for (int i = 1; i <= aSurface->NbUPoles(); i++)
+		{
+			for (int j = 1; j <= aSurface->NbVPoles(); j++)
+			{
+				QuantizePoint(aSurface->Pole(i, j), coords);
+				for (auto&& coord : coords)
+				{
+					HashCombine(seed, coord);
+				}
+				if (aSurface->IsURational() || aSurface->IsVRational())
+				{
+					HashCombine(seed, std::llround(aSurface->Weight(i, j) / Precision::Confusion()));
+				}
+			}
+		}
+		return seed;
+	}
+
+	void FingerprintSurface(const Adaptor3d_Surface& aSurface, const TopoDS_Face& aFace, SurfaceFingerprint& fingerprint)
+	{
+		long long* values = fingerprint.Values;
+		fingerprint.SurfaceType = static_cast<int>(aSurface.GetType());
+		switch (aSurface.GetType())
+		{
+			case GeomAbs_Plane:
+			{
+				// Same normal (either way round), and same distance along it from the origin
+				const gp_Pln plane = aSurface.Plane();
+				const gp_Dir normal = plane.Axis().Direction();
+				QuantizeDirection(normal, values);
+				values[3] = QuantizeLength(CanonicalSign(normal) * plane.Location().XYZ().Dot(normal.XYZ()));
+				break;
+			}
+			case GeomAbs_Cylinder:
+			{
+				const gp_Cylinder cylinder = aSurface.Cylinder();
+				const gp_Dir axis = cylinder.Axis().Direction();
+				QuantizeDirection(axis, values);
+				QuantizePoint(AxisPoint(cylinder.Location(), axis), values + 3);
+				values[6] = QuantizeLength(cylinder.Radius());
+				break;
+			}
+			case GeomAbs_Cone:
+			{
+				// The apex and the semi-angle pin the cone down, once the axis points the
+				// way the cone opens
+				const gp_Cone cone = aSurface.Cone();
+				gp_Dir axis = cone.Axis().Direction();
+				if (cone.SemiAngle() < 0.)
+				{
+					axis.Reverse();
+				}
+				for (int i = 0; i < 3; i++)
+				{
+					values[i] = std::llround(axis.Coord(i + 1) / Precision::Angular());
+				}
+				QuantizePoint(cone.Apex(), values + 3);
+				values[6] = std::llround(std::abs(cone.SemiAngle()) / Precision::Angular());
+				break;
+			}
+			case GeomAbs_Sphere:
+			{
+				const gp_Sphere sphere = aSurface.Sphere();
+				QuantizePoint(sphere.Location(), values);
+				values[3] = QuantizeLength(sphere.Radius());
+				break;
+			}
+			case GeomAbs_Torus:
+			{
+				const gp_Torus torus = aSurface.Torus();
+				QuantizeDirection(torus.Axis().Direction(), values);
+				QuantizePoint(torus.Location(), values + 3);
+				values[6] = QuantizeLength(torus.MajorRadius());
+				values[7] = QuantizeLength(torus.MinorRadius());
+				break;
+			}
+			case GeomAbs_BSplineSurface:
+			{
+				Handle(Geom_BSplineSurface) bspline = aSurface.BSpline();
+				values[0] = bspline->UDegree();
+				values[1] = bspline->VDegree();
+				values[2] = bspline->NbUPoles();
+				values[3] = bspline->NbVPoles();
+				values[4] = bspline->NbUKnots();
+				values[5] = bspline->NbVKnots();
+				fingerprint.Detail = HashPoles(bspline);
+				for (int i = 1; i <= bspline->NbUKnots(); i++)
+				{
+					HashCombine(fingerprint.Detail, std::llround(bspline->UKnot(i) / Precision::PConfusion()));
+					HashCombine(fingerprint.Detail, bspline->UMultiplicity(i));
+				}
+				for (int i = 1; i <= bspline->NbVKnots(); i++)
+				{
+					HashCombine(fingerprint.Detail, std::llround(bspline->VKnot(i) / Precision::PConfusion()));
+					HashCombine(fingerprint.Detail, bspline->VMultiplicity(i));
+				}
+				break;
+			}
+			case GeomAbs_BezierSurface:
+			{
+				Handle(Geom_BezierSurface) bezier = aSurface.Bezier();
+				values[0] = bezier->UDegree();
+				values[1] = bezier->VDegree();
+				fingerprint.Detail = HashPoles(bezier);
+				break;
+			}
+			default:
+			{
+				// Extrusions, revolutions and anything else: sample the surface at a few
+				// fixed spots inside the face's parameter range
+				double uMin, uMax, vMin, vMax;
+				BRepTools::UVBounds(aFace, uMin, uMax, vMin, vMax);
+				const double fractions[3][2] = { { 0.25, 0.25 }, { 0.5, 0.75 }, { 0.75, 0.5 } };
+				for (int i = 0; i < 3; i++)
+				{
+					const gp_Pnt sample = aSurface.Value(uMin + fractions[i][0] * (uMax - uMin), vMin + fractions[i][1] * (vMax - vMin));
+					QuantizePoint(sample, values + 3 * i);
+				}
+				break;
+			}
+		}
+	}
+}
+
+bool EdgeKey::operator == (const EdgeKey& other) const
+{
+	return CurveType == other.CurveType && Closed == other.Closed && std::equal(Points, Points + 6, other.Points);
+}
+
+std::size_t EdgeKeyHasher::operator()(const EdgeKey& aKey) const
+{
+	std::size_t seed = std::hash<int>()(aKey.CurveType * 2 + (aKey.Closed ? 1 : 0));
+	for (auto&& coord : aKey.Points)
+	{
+		HashCombine(seed, coord);
+	}
+	return seed;
+}
+
+EdgeKey MakeEdgeKey(const TopoDS_Edge& anEdge)
+{
+	EdgeKey aKey;
+	gp_Pnt start, end;
+	double first, last;
+	Handle(Geom_Curve) curve = BRep_Tool::Curve(anEdge, first, last);
+	if (curve.IsNull())
+	{
+		// Degenerated edge, all that's left is the vertexes
+		TopoDS_Vertex vertex1, vertex2;
+		TopExp::Vertices(anEdge, vertex1, vertex2);
+		start = vertex1.IsNull() ? gp_Pnt() : BRep_Tool::Pnt(vertex1);
+		end = vertex2.IsNull() ? start : BRep_Tool::Pnt(vertex2);
+		aKey.CurveType = -1;
+		aKey.Closed = false;
+	}
+	else
+	{
+		// Same end points that CompareTwoEdgeTopologies looks at
+		start = curve->Value(first);
+		end = curve->Value(last);
+		aKey.CurveType = static_cast<int>(GeomAdaptor_Curve(curve).GetType());
+		aKey.Closed = curve->IsClosed();
+	}
+
+	QuantizePoint(start, aKey.Points);
+	QuantizePoint(end, aKey.Points + 3);
+	if (std::lexicographical_compare(aKey.Points + 3, aKey.Points + 6, aKey.Points, aKey.Points + 3))
+	{
+		std::swap_ranges(aKey.Points, aKey.Points + 3, aKey.Points + 3);
+	}
+	return aKey;
+}
+
+SurfaceFingerprint MakeSurfaceFingerprint(const TopoDS_Face& aFace)
+{
+	SurfaceFingerprint fingerprint;
+	fingerprint.Offset = false;
+	fingerprint.Detail = 0;
+	std::fill(fingerprint.Values, fingerprint.Values + SurfaceFingerprint::Size, 0);
+
+	// BRepAdaptor_Surface takes care of the face's Location and of trimmed surfaces
+	BRepAdaptor_Surface adaptor(aFace);
+	if (adaptor.GetType() == GeomAbs_OffsetSurface)
+	{
+		// Fingerprint the basis surface, and keep the offset distance in the last slot
+		fingerprint.Offset = true;
+		fingerprint.Values[SurfaceFingerprint::Size - 1] = QuantizeLength(adaptor.OffsetValue());
+		FingerprintSurface(adaptor.BasisSurface()->Surface(), aFace, fingerprint);
+	}
+	else
+	{
+		FingerprintSurface(adaptor, aFace, fingerprint);
+	}
+	return fingerprint;
+}
+
+bool SurfaceFingerprint::operator == (const SurfaceFingerprint& other) const
+{
+	return SurfaceType == other.SurfaceType && Offset == other.Offset && Detail == other.Detail &&
+		std::equal(Values, Values + Size, other.Values);
+}
+
+std::size_t SurfaceFingerprintHasher::operator()(const SurfaceFingerprint& aFingerprint) const
+{
+	std::size_t seed = aFingerprint.Detail;
+	HashCombine(seed, aFingerprint.SurfaceType * 2 + (aFingerprint.Offset ? 1 : 0));
+	for (auto&& value : aFingerprint.Values)
+	{
+		HashCombine(seed, value);
+	}
+	return seed;
+}
+
+bool FingerprintsMatch(const SurfaceFingerprint& fingerprint1, const SurfaceFingerprint& fingerprint2)
+{
+	if (fingerprint1.SurfaceType != fingerprint2.SurfaceType || fingerprint1.Offset != fingerprint2.Offset ||
+		fingerprint1.Detail != fingerprint2.Detail)
+	{
+		return false;
+	}
+	for (int i = 0; i < SurfaceFingerprint::Size; i++)
+	{
+		if (std::abs(fingerprint1.Values[i] - fingerprint2.Values[i]) > 1)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SameSurfaceKind(const SurfaceFingerprint& fingerprint1, const SurfaceFingerprint& fingerprint2)
+{
+	if (fingerprint1.SurfaceType != fingerprint2.SurfaceType || fingerprint1.Offset != fingerprint2.Offset)
+	{
+		return false;
+	}
+	switch (fingerprint1.SurfaceType)
+	{
+		case GeomAbs_Plane:
+		case GeomAbs_Cylinder:
+		case GeomAbs_Cone:
+		case GeomAbs_Torus:
+		{
+			// Values[0..2] hold the (quantized) direction of the axis
+			const double tolerance = 1.e-6;
+			for (int i = 0; i < 3; i++)
+			{
+				if (std::abs(fingerprint1.Values[i] - fingerprint2.Values[i]) * Precision::Angular() > tolerance)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+		default:
+			return true;
+	}
+}
+
+EdgeSignature ComputeEdgeSignature(const TopoDS_Edge& anEdge, const TopTools_ListOfShape& AdjacentFaces)
+{
+	EdgeSignature signature;
+
+	if (BRep_Tool::Degenerated(anEdge))
+	{
+		// No 3D curve to speak of, all we have is the vertex
+		TopExp_Explorer vertexes(anEdge, TopAbs_VERTEX);
+		gp_Pnt aPoint = vertexes.More() ? BRep_Tool::Pnt(TopoDS::Vertex(vertexes.Current())) : gp_Pnt();
+		signature.CurveType = -1;
+		signature.First = signature.Last = signature.Middle = aPoint;
+		signature.Length = 0.;
+		return signature;
+	}
+
+	BRepAdaptor_Curve curve(anEdge);
+	const double first = curve.FirstParameter();
+	const double last = curve.LastParameter();
+	const double middle = 0.5 * (first + last);
+	signature.CurveType = static_cast<int>(curve.GetType());
+	signature.First = curve.Value(first);
+	signature.Last = curve.Value(last);
+	signature.Middle = curve.Value(middle);
+	signature.Length = GCPnts_AbscissaPoint::Length(curve);
+
+	int n = 0;
+	for (TopTools_ListIteratorOfListOfShape it(AdjacentFaces); it.More() && n < 2; it.Next())
+	{
+		const TopoDS_Face& aFace = TopoDS::Face(it.Value());
+		double pFirst, pLast;
+		Handle(Geom2d_Curve) pCurve = BRep_Tool::CurveOnSurface(anEdge, aFace, pFirst, pLast);
+		if (pCurve.IsNull())
+		{
+			continue;
+		}
+		// The edges made by the modeling algorithms are SameParameter, so the pcurve
+		// parameter matches the 3D one.
+		gp_Pnt2d uv = pCurve->Value(middle);
+		gp_Pnt onFace;
+		gp_Vec normal;
+		BRepGProp_Face faceProps(aFace);
+		faceProps.Normal(uv.X(), uv.Y(), onFace, normal);
+		if (normal.Magnitude() > gp::Resolution())
+		{
+			normal.Normalize();
+		}
+		signature.Normals[n++] = normal;
+	}
+	return signature;
+}
+
+void StoreEdgeSignature(const TDF_Label& aLabel, const EdgeSignature& aSignature)
+{
+	Handle(TDataStd_RealArray) anArray = TDataStd_RealArray::Set(aLabel, 0, SignatureSize - 1);
+	anArray->SetValue(0, static_cast<double>(aSignature.CurveType));
+	StorePoint(anArray, 1, aSignature.First.XYZ());
+	StorePoint(anArray, 4, aSignature.Last.XYZ());
+	StorePoint(anArray, 7, aSignature.Middle.XYZ());
+	anArray->SetValue(10, aSignature.Length);
+	StorePoint(anArray, 11, aSignature.Normals[0].XYZ());
+	StorePoint(anArray, 14, aSignature.Normals[1].XYZ());
+}
+
+bool RetrieveEdgeSignature(const TDF_Label& aLabel, EdgeSignature& aSignature)
+{
+	Handle(TDataStd_RealArray) anArray;
+	if (!aLabel.FindAttribute(TDataStd_RealArray::GetID(), anArray) || anArray->Length() != SignatureSize)
+	{
+		return false;
+	}
+	aSignature.CurveType = static_cast<int>(anArray->Value(0));
+	aSignature.First = RetrievePoint(anArray, 1);
+	aSignature.Last = RetrievePoint(anArray, 4);
+	aSignature.Middle = RetrievePoint(anArray, 7);
+	aSignature.Length = anArray->Value(10);
+	aSignature.Normals[0] = RetrievePoint(anArray, 11);
+	aSignature.Normals[1] = RetrievePoint(anArray, 14);
+	return true;
+}
+
+double SignatureDistance(const EdgeSignature& signature1, const EdgeSignature& signature2)
+{
+	if (signature1.CurveType != signature2.CurveType)
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+
+	// Neither the orientation of the edge nor the order of its faces is guaranteed to
+	// survive a rebuild, so take whichever pairing fits best.
+	const double endPoints = std::min(
+		signature1.First.Distance(signature2.First) + signature1.Last.Distance(signature2.Last),
+		signature1.First.Distance(signature2.Last) + signature1.Last.Distance(signature2.First));
+	const double normals = std::min(
+		(signature1.Normals[0] - signature2.Normals[0]).Magnitude() + (signature1.Normals[1] - signature2.Normals[1]).Magnitude(),
+		(signature1.Normals[0] - signature2.Normals[1]).Magnitude() + (signature1.Normals[1] - signature2.Normals[0]).Magnitude());
+	// normals are unit-less, so scale them by the size of the edges
+	const double scale = std::max(0.5 * (signature1.Length + signature2.Length), Precision::Confusion());
+
+	return signature1.Middle.Distance(signature2.Middle) + endPoints
+		+ std::abs(signature1.Length - signature2.Length) + normals * scale;
+}
+
+EdgeSignatureIndex::EdgeSignatureIndex(const TopologyIndex& Topology) : myEdgeBVH(&Topology.EdgeBVH())
+{
+	const TopTools_IndexedMapOfShape& edges = Topology.Edges();
+	TopTools_IndexedDataMapOfShapeListOfShape edgeFaces;
+	TopExp::MapShapesAndAncestors(Topology.Shape(), TopAbs_EDGE, TopAbs_FACE, edgeFaces);
+
+	const TopTools_ListOfShape noFaces;
+	mySignatures.reserve(edges.Extent());
+	for (int i = 1; i <= edges.Extent(); i++)
+	{
+		const TopoDS_Edge& anEdge = TopoDS::Edge(edges(i));
+		const TopTools_ListOfShape& faces = edgeFaces.Contains(anEdge) ? edgeFaces.FindFromKey(anEdge) : noFaces;
+		mySignatures.push_back(ComputeEdgeSignature(anEdge, faces));
+	}
+}
+
+int EdgeSignatureIndex::FindBestMatch(const EdgeSignature& aSignature) const
+{
+	// An edge's mid-point is inside its box, and the signature distance is never less
+	// than the mid-point distance, so once the boxes are further away than the best match
+	// so far nothing left can beat it.
+	int best = 0;
+	double bestDistance = std::numeric_limits<double>::infinity();
+	myEdgeBVH->VisitNearest(aSignature.Middle, [&](const int& n, const double& boxDistance)
+	{
+		if (boxDistance > bestDistance)
+		{
+			return false;
+		}
+		const double distance = SignatureDistance(aSignature, mySignatures[n - 1]);
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = n;
+		}
+		return true;
+	});
+	return best;
+}
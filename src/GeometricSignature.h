@@ -0,0 +1,134 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef GEOMETRIC_SIGNATURE_H
+#define GEOMETRIC_SIGNATURE_H
+
+#include <cstddef>
+#include <vector>
+
+#include <TDF_Label.hxx>
+#include <TopoDS_Edge.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopTools_ListOfShape.hxx>
+#include <gp_Pnt.hxx>
+#include <gp_Vec.hxx>
+
+class TopologyIndex;
+class ShapeBVH;
+
+// A cheap, hashable stand-in for an edge: the curve type, whether it's closed, and its
+// two end points snapped to a grid of Precision::Confusion() and sorted, so that the
+// same edge gives the same key whichever way round it goes. Equal edges nearly always
+// have equal keys; the exception is an end point that sits right on a grid line, so a
+// key miss still needs a slower check.
+struct EdgeKey
+{
+	int CurveType;
+	bool Closed;
+	long long Points[6];
+
+	bool operator == (const EdgeKey& other) const;
+};
+
+struct EdgeKeyHasher
+{
+	std::size_t operator()(const EdgeKey& aKey) const;
+};
+
+EdgeKey MakeEdgeKey(const TopoDS_Edge& anEdge);
+
+// A compact description of an edge's geometry, stored alongside each edge selection.
+// If TNaming can't solve the selection any more, the edge in the new shape whose
+// signature is closest to this one is used instead.
+struct EdgeSignature
+{
+	// GeomAbs_CurveType of the underlying curve
+	int CurveType;
+	gp_Pnt First;
+	gp_Pnt Last;
+	gp_Pnt Middle;
+	double Length;
+	// Normals of (up to) two adjacent faces at Middle. A missing face has a zero normal
+	gp_Vec Normals[2];
+};
+
+// A fixed-size description of the surface underneath a face, which is the same for any
+// two faces that lie on the same surface. Lengths are snapped to Precision::Confusion()
+// and directions to Precision::Angular(). Directions are flipped to a canonical sign, so
+// e.g. both sides of a plane give the same fingerprint.
+struct SurfaceFingerprint
+{
+	static const int Size = 12;
+
+	// GeomAbs_SurfaceType. For an offset surface this is the type of the basis surface
+	int SurfaceType;
+	bool Offset;
+	// What these hold depends on SurfaceType, unused ones are zero
+	long long Values[Size];
+	// Hash of the poles, weights and knots of a BSpline or Bezier surface, zero otherwise
+	std::size_t Detail;
+
+	// Exact equality, for use as a hash key. Use FingerprintsMatch to compare surfaces.
+	bool operator == (const SurfaceFingerprint& other) const;
+};
+
+struct SurfaceFingerprintHasher
+{
+	std::size_t operator()(const SurfaceFingerprint& aFingerprint) const;
+};
+
+SurfaceFingerprint MakeSurfaceFingerprint(const TopoDS_Face& aFace);
+// Do the two fingerprints describe the same surface? Each of Values is allowed to be off
+// by one, so that a value right on a rounding boundary doesn't cause a mismatch.
+bool FingerprintsMatch(const SurfaceFingerprint& fingerprint1, const SurfaceFingerprint& fingerprint2);
+
+// Could one surface plausibly have been modified into the other? True if they are the
+// same kind of surface, and for planes, cylinders, cones and tori if their axes are
+// (nearly) parallel.
+bool SameSurfaceKind(const SurfaceFingerprint& fingerprint1, const SurfaceFingerprint& fingerprint2);
+
+// Compute the signature of anEdge, with AdjacentFaces being the faces that share it
+EdgeSignature ComputeEdgeSignature(const TopoDS_Edge& anEdge, const TopTools_ListOfShape& AdjacentFaces);
+// Store aSignature on aLabel as a TDataStd_RealArray
+void StoreEdgeSignature(const TDF_Label& aLabel, const EdgeSignature& aSignature);
+// Read back a signature written by StoreEdgeSignature. Returns false if there isn't one
+bool RetrieveEdgeSignature(const TDF_Label& aLabel, EdgeSignature& aSignature);
+// How different two signatures are. Zero means identical, and the result is never less
+// than the distance between the two mid-points, which is what the EdgeSignatureIndex
+// relies on to stop searching early. Edges of different curve types are infinitely far
+// apart.
+double SignatureDistance(const EdgeSignature& signature1, const EdgeSignature& signature2);
+
+// The signature of every edge in a TopologyIndex. The closest match is found through the
+// TopologyIndex's EdgeBVH, so only the edges near the mid-point get looked at.
+class EdgeSignatureIndex
+{
+public:
+	explicit EdgeSignatureIndex(const TopologyIndex& Topology);
+
+	// Signature of the nth edge (1 based, same as TopologyIndex::Edges())
+	const EdgeSignature& Signature(const int& n) const { return mySignatures[n - 1]; }
+	// Index (1 based) of the edge whose signature is closest to aSignature, or 0 if
+	// there's no edge of the same curve type
+	int FindBestMatch(const EdgeSignature& aSignature) const;
+
+private:
+	std::vector<EdgeSignature> mySignatures;
+	// Owned by the same TopologyIndex that owns this
+	const ShapeBVH* myEdgeBVH;
+};
+#endif /* ifndef GEOMETRIC_SIGNATURE_H */
@@ -0,0 +1,645 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <BinTools_ShapeSet.hxx>
+#include <TCollection_AsciiString.hxx>
+#include <TDataStd_AsciiString.hxx>
+#include <TDataStd_RealArray.hxx>
+#include <TDF_AttributeIterator.hxx>
+#include <TDF_ChildIterator.hxx>
+#include <TDF_LabelMap.hxx>
+#include <TDF_TagSource.hxx>
+#include <TNaming_Builder.hxx>
+#include <TNaming_Iterator.hxx>
+#include <TNaming_ListIteratorOfListOfNamedShape.hxx>
+#include <TNaming_Name.hxx>
+#include <TNaming_NamedShape.hxx>
+#include <TNaming_Naming.hxx>
+#include <TopoDS_Shape.hxx>
+
+#include "HistoryArchive.h"
+#include "ShapeHasher.h"
+#include "TopoNamingHelper.h"
+#include "TopoNamingLog.h"
+
+namespace
+{
+	const char Magic[4] = { 'T', 'N', 'H', 'S' };
+	const uint32_t Version = 1;
+	// magic, version, three counts-ish uint32's and four uint64 offsets/sizes
+	const size_t HeaderSize = 4 + 3 * 4 + 4 * 8;
+
+	// The one byte that starts each attribute in the labels section
+	const char TagSourceKind = 'T';
+	const char TextKind = 'A';
+	const char RealArrayKind = 'R';
+	const char NamedShapeKind = 'N';
+	const char NamingKind = 'M';
+
+	void PutUInt32(std::string& out, const uint32_t& value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			out += static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	void PutInt32(std::string& out, const int32_t& value)
+	{
+		PutUInt32(out, static_cast<uint32_t>(value));
+	}
+
+	void PutUInt64(std::string& out, const uint64_t& value)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			out += static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	void PutDouble(std::string& out, const double& value)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		PutUInt64(out, bits);
+	}
+
+	// Tags from the Root down, the Root's own (0) included
+	void PutPath(std::string& out, const TDF_Label& aLabel)
+	{
+		std::vector<int32_t> tags;
+		for (TDF_Label curLabel = aLabel; !curLabel.IsNull(); curLabel = curLabel.Father())
+		{
+			tags.push_back(curLabel.Tag());
+		}
+		PutUInt32(out, static_cast<uint32_t>(tags.size()));
+		for (auto it = tags.rbegin(); it != tags.rend(); ++it)
+		{
+			PutInt32(out, *it);
+		}
+	}
+
+	// Reads the numbers written by the Put's above out of a block of memory, throwing if
+	// it runs off the end
+	class Reader
+	{
+	public:
+		Reader(const char* begin, const char* end) : myPos(begin), myEnd(end)
+		{}
+
+		const char* Take(const size_t& n)
+		{
+			if (static_cast<size_t>(myEnd - myPos) < n)
+			{
+				throw std::runtime_error("The history file is truncated or corrupt");
+			}
+			const char* out = myPos;
+			myPos += n;
+			return out;
+		}
+
+		uint64_t UInt(const int& bytes)
+		{
+			const unsigned char* data = reinterpret_cast<const unsigned char*>(this->Take(bytes));
+			uint64_t value = 0;
+			for (int i = 0; i < bytes; i++)
+			{
+				value |= static_cast<uint64_t>(data[i]) << (8 * i);
+			}
+			return value;
+		}
+
+		uint32_t UInt32()
+		{
+			return static_cast<uint32_t>(this->UInt(4));
+		}
+
+		int32_t Int32()
+		{
+			return static_cast<int32_t>(this->UInt32());
+		}
+
+		uint64_t UInt64()
+		{
+			return this->UInt(8);
+		}
+
+		double Double()
+		{
+			uint64_t bits = this->UInt64();
+			double value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		const char* Position() const
+		{
+			return myPos;
+		}
+
+	private:
+		const char* myPos;
+		const char* myEnd;
+	};
+
+	// The label at the path written by PutPath, made if it isn't there yet. A path of
+	// depth 0 is a null label.
+	TDF_Label ReadPath(Reader& in, const TDF_Label& Root)
+	{
+		const uint32_t depth = in.UInt32();
+		if (depth == 0)
+		{
+			return TDF_Label();
+		}
+		in.Int32();
+		TDF_Label aLabel = Root;
+		for (uint32_t i = 1; i < depth; i++)
+		{
+			aLabel = aLabel.FindChild(in.Int32(), Standard_True);
+		}
+		return aLabel;
+	}
+
+	// Lets BinTools read straight out of the mapped file without copying it
+	class MemoryBuffer : public std::streambuf
+	{
+	public:
+		MemoryBuffer(const char* begin, const char* end)
+		{
+			char* first = const_cast<char*>(begin);
+			this->setg(first, first, const_cast<char*>(end));
+		}
+
+	protected:
+		pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override
+		{
+			char* target = direction == std::ios_base::beg ? this->eback() + offset :
+						   direction == std::ios_base::cur ? this->gptr() + offset : this->egptr() + offset;
+			if (target < this->eback() || target > this->egptr())
+			{
+				return pos_type(off_type(-1));
+			}
+			this->setg(this->eback(), target, this->egptr());
+			return pos_type(target - this->eback());
+		}
+
+		pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+		{
+			return this->seekoff(off_type(position), std::ios_base::beg, mode);
+		}
+	};
+
+	// A read-only mapping of a whole file, unmapped again when it goes out of scope
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& FileName)
+		{
+			int fd = ::open(FileName.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				throw std::runtime_error("Could not open " + FileName);
+			}
+			struct stat info;
+			if (::fstat(fd, &info) != 0)
+			{
+				::close(fd);
+				throw std::runtime_error("Could not stat " + FileName);
+			}
+			mySize = static_cast<size_t>(info.st_size);
+			if (mySize > 0)
+			{
+				void* data = ::mmap(nullptr, mySize, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data == MAP_FAILED)
+				{
+					::close(fd);
+					throw std::runtime_error("Could not map " + FileName);
+				}
+				myData = static_cast<const char*>(data);
+			}
+			// The mapping keeps the file around on its own
+			::close(fd);
+		}
+
+		~MappedFile()
+		{
+			if (myData)
+			{
+				::munmap(const_cast<char*>(myData), mySize);
+			}
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator = (const MappedFile&) = delete;
+
+		const char* Data() const
+		{
+			return myData;
+		}
+
+		size_t Size() const
+		{
+			return mySize;
+		}
+
+	private:
+		const char* myData = nullptr;
+		size_t mySize = 0;
+	};
+
+	// A NamedShape or Naming read from the file, kept until every label exists so they can
+	// be built in the right order
+	struct PendingAttribute
+	{
+		TDF_Label Label;
+		const char* Begin;
+		const char* End;
+	};
+}
+
+void HistoryArchive::Write(const TDF_Label& Root, const std::string& FileName)
+{
+	// Every shape gets added to the one shape set, so sub-shapes shared between shapes are
+	// only written once and are still shared when read back
+	BinTools_ShapeSet shapeSet;
+	std::vector<TopoDS_Shape> shapes;
+	std::unordered_map<TopoDS_Shape, uint32_t, ShapeHasher, ShapeIsEqual> shapeIds;
+	auto idOf = [&](const TopoDS_Shape& aShape) -> uint32_t
+	{
+		if (aShape.IsNull())
+		{
+			return 0;
+		}
+		auto inserted = shapeIds.emplace(aShape, static_cast<uint32_t>(shapes.size() + 1));
+		if (inserted.second)
+		{
+			shapeSet.Add(aShape);
+			shapes.push_back(aShape);
+		}
+		return inserted.first->second;
+	};
+
+	std::string labels;
+	std::string record;
+	uint32_t numLabels = 0;
+	std::vector<TDF_Label> allLabels(1, Root);
+	for (TDF_ChildIterator it(Root, Standard_True); it.More(); it.Next())
+	{
+		allLabels.push_back(it.Value());
+	}
+	for (auto&& aLabel : allLabels)
+	{
+		record.clear();
+		PutPath(record, aLabel);
+		std::string attributes;
+		uint32_t numAttributes = 0;
+		for (TDF_AttributeIterator it(aLabel); it.More(); it.Next())
+		{
+			const Handle(TDF_Attribute)& attribute = it.Value();
+			if (attribute->IsKind(STANDARD_TYPE(TDF_TagSource)))
+			{
+				attributes += TagSourceKind;
+				PutInt32(attributes, Handle(TDF_TagSource)::DownCast(attribute)->Get());
+			}
+			else if (attribute->IsKind(STANDARD_TYPE(TDataStd_AsciiString)))
+			{
+				const TCollection_AsciiString& text = Handle(TDataStd_AsciiString)::DownCast(attribute)->Get();
+				attributes += TextKind;
+				PutUInt32(attributes, static_cast<uint32_t>(text.Length()));
+				attributes.append(text.ToCString(), static_cast<size_t>(text.Length()));
+			}
+			else if (attribute->IsKind(STANDARD_TYPE(TDataStd_RealArray)))
+			{
+				Handle(TDataStd_RealArray) values = Handle(TDataStd_RealArray)::DownCast(attribute);
+				attributes += RealArrayKind;
+				PutInt32(attributes, values->Lower());
+				PutInt32(attributes, values->Upper());
+				for (int i = values->Lower(); i <= values->Upper(); i++)
+				{
+					PutDouble(attributes, values->Value(i));
+				}
+			}
+			else if (attribute->IsKind(STANDARD_TYPE(TNaming_NamedShape)))
+			{
+				Handle(TNaming_NamedShape) aNS = Handle(TNaming_NamedShape)::DownCast(attribute);
+				std::vector<std::pair<uint32_t, uint32_t>> pairs;
+				for (TNaming_Iterator pairIt(aNS); pairIt.More(); pairIt.Next())
+				{
+					pairs.emplace_back(idOf(pairIt.OldShape()), idOf(pairIt.NewShape()));
+				}
+				attributes += NamedShapeKind;
+				PutInt32(attributes, static_cast<int32_t>(aNS->Evolution()));
+				PutInt32(attributes, aNS->Version());
+				PutUInt32(attributes, static_cast<uint32_t>(pairs.size()));
+				for (auto&& ids : pairs)
+				{
+					PutUInt32(attributes, ids.first);
+					PutUInt32(attributes, ids.second);
+				}
+			}
+			else if (attribute->IsKind(STANDARD_TYPE(TNaming_Naming)))
+			{
+				const TNaming_Name& name = Handle(TNaming_Naming)::DownCast(attribute)->GetName();
+				attributes += NamingKind;
+				PutInt32(attributes, static_cast<int32_t>(name.Type()));
+				PutInt32(attributes, static_cast<int32_t>(name.ShapeType()));
+				PutUInt32(attributes, idOf(name.Shape()));
+				PutInt32(attributes, name.Index());
+				PutInt32(attributes, static_cast<int32_t>(name.Orientation()));
+				PutPath(attributes, name.ContextLabel());
+				PutPath(attributes, name.StopNamedShape().IsNull() ? TDF_Label() : name.StopNamedShape()->Label());
+				PutUInt32(attributes, static_cast<uint32_t>(name.Arguments().Extent()));
+				for (TNaming_ListIteratorOfListOfNamedShape arguments(name.Arguments()); arguments.More(); arguments.Next())
+				{
+					PutPath(attributes, arguments.Value()->Label());
+				}
+			}
+			else if (!attribute->IsKind(STANDARD_TYPE(TNaming_UsedShapes)))
+			{
+				// UsedShapes gets re-built on the way back in, anything else we don't know about
+				TN_LOG_WARNING(TopoNamingLog::IO, "Not saving a " << attribute->DynamicType()->Name() << " attribute");
+				continue;
+			}
+			else
+			{
+				continue;
+			}
+			numAttributes++;
+		}
+		PutUInt32(record, numAttributes);
+		record += attributes;
+
+		PutUInt32(labels, static_cast<uint32_t>(record.size()));
+		labels += record;
+		numLabels++;
+	}
+
+	std::ostringstream shapeSetStream(std::ios::out | std::ios::binary);
+	shapeSet.Write(shapeSetStream);
+	const std::string shapeSetData = shapeSetStream.str();
+
+	// Each shape's reference into the shape set, and where it starts
+	std::string references;
+	std::string shapeTable;
+	for (auto&& aShape : shapes)
+	{
+		PutUInt64(shapeTable, references.size());
+		std::ostringstream reference(std::ios::out | std::ios::binary);
+		shapeSet.Write(aShape, reference);
+		references += reference.str();
+	}
+
+	std::string header(Magic, sizeof(Magic));
+	const uint64_t shapeSetOffset = HeaderSize;
+	const uint64_t shapeTableOffset = shapeSetOffset + shapeSetData.size();
+	const uint64_t labelsOffset = shapeTableOffset + shapeTable.size() + references.size();
+	PutUInt32(header, Version);
+	PutUInt32(header, static_cast<uint32_t>(shapes.size()));
+	PutUInt32(header, numLabels);
+	PutUInt64(header, shapeSetOffset);
+	PutUInt64(header, shapeSetData.size());
+	PutUInt64(header, shapeTableOffset);
+	PutUInt64(header, labelsOffset);
+
+	std::ofstream file(FileName, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		throw std::runtime_error("Could not open " + FileName + " for writing");
+	}
+	const std::string* sections[] = { &header, &shapeSetData, &shapeTable, &references, &labels };
+	for (auto&& section : sections)
+	{
+		file.write(section->data(), section->size());
+	}
+	if (!file)
+	{
+		throw std::runtime_error("Could not write the history to " + FileName);
+	}
+}
+
+void HistoryArchive::Read(const std::string& FileName, const TDF_Label& Root)
+{
+	MappedFile mapped(FileName);
+	const char* const fileBegin = mapped.Data();
+	const char* const fileEnd = fileBegin + mapped.Size();
+
+	Reader header(fileBegin, fileEnd);
+	if (mapped.Size() < HeaderSize || std::memcmp(header.Take(sizeof(Magic)), Magic, sizeof(Magic)) != 0)
+	{
+		throw std::runtime_error(FileName + " is not a topological naming history");
+	}
+	if (header.UInt32() != Version)
+	{
+		throw std::runtime_error(FileName + " was saved by a different version");
+	}
+	const uint32_t numShapes = header.UInt32();
+	const uint32_t numLabels = header.UInt32();
+	const uint64_t shapeSetOffset = header.UInt64();
+	const uint64_t shapeSetSize = header.UInt64();
+	const uint64_t shapeTableOffset = header.UInt64();
+	const uint64_t labelsOffset = header.UInt64();
+	// Each size is checked against what's left, rather than adding it to its offset, so
+	// that a corrupt header can't overflow its way past the checks
+	const uint64_t fileSize = mapped.Size();
+	if (shapeSetOffset > fileSize || shapeSetSize > fileSize - shapeSetOffset || labelsOffset > fileSize ||
+		shapeTableOffset > labelsOffset || 8 * static_cast<uint64_t>(numShapes) > labelsOffset - shapeTableOffset)
+	{
+		throw std::runtime_error("The history file is truncated or corrupt");
+	}
+	const uint64_t referencesOffset = shapeTableOffset + 8 * static_cast<uint64_t>(numShapes);
+
+	// NOTE: the shape set is read whole, up front. Its sub-shapes, curves, surfaces and
+	// locations all refer to one another by index, so BinTools_ShapeSet can't read just a
+	// part of it. All that's left to do lazily is to put each shape together (its TShape,
+	// Location and Orientation) when a label first needs it.
+	BinTools_ShapeSet shapeSet;
+	{
+		MemoryBuffer buffer(fileBegin + shapeSetOffset, fileBegin + shapeSetOffset + shapeSetSize);
+		std::istream stream(&buffer);
+		shapeSet.Read(stream);
+	}
+	std::vector<TopoDS_Shape> shapes(numShapes);
+	std::vector<bool> decoded(numShapes, false);
+	Reader shapeTable(fileBegin + shapeTableOffset, fileBegin + referencesOffset);
+	std::vector<uint64_t> shapeOffsets(numShapes);
+	for (auto&& offset : shapeOffsets)
+	{
+		offset = shapeTable.UInt64();
+	}
+	auto shapeOf = [&](const uint32_t& id) -> TopoDS_Shape
+	{
+		if (id == 0)
+		{
+			return TopoDS_Shape();
+		}
+		if (id > numShapes)
+		{
+			throw std::runtime_error("The history file is truncated or corrupt");
+		}
+		if (!decoded[id - 1])
+		{
+			if (shapeOffsets[id - 1] > labelsOffset - referencesOffset)
+			{
+				throw std::runtime_error("The history file is truncated or corrupt");
+			}
+			const uint64_t start = referencesOffset + shapeOffsets[id - 1];
+			MemoryBuffer buffer(fileBegin + start, fileBegin + labelsOffset);
+			std::istream stream(&buffer);
+			shapeSet.Read(shapes[id - 1], stream, shapeSet.NbShapes());
+			decoded[id - 1] = true;
+		}
+		return shapes[id - 1];
+	};
+
+	// First every label and its plain attributes. NamedShapes wait until all the labels
+	// exist, and Namings until all the NamedShapes do.
+	std::vector<PendingAttribute> namedShapes, selectionShapes, namings;
+	TDF_LabelMap selections;
+	Reader labels(fileBegin + labelsOffset, fileEnd);
+	for (uint32_t n = 0; n < numLabels; n++)
+	{
+		const uint32_t length = labels.UInt32();
+		const char* recordBegin = labels.Take(length);
+		Reader record(recordBegin, recordBegin + length);
+		TDF_Label aLabel = ReadPath(record, Root);
+		const uint32_t numAttributes = record.UInt32();
+		for (uint32_t i = 0; i < numAttributes; i++)
+		{
+			const char kind = *record.Take(1);
+			if (kind == TagSourceKind)
+			{
+				TDF_TagSource::Set(aLabel)->Set(record.Int32());
+			}
+			else if (kind == TextKind)
+			{
+				const uint32_t textLength = record.UInt32();
+				const std::string text(record.Take(textLength), textLength);
+				TDataStd_AsciiString::Set(aLabel, TCollection_AsciiString(text.c_str()));
+			}
+			else if (kind == RealArrayKind)
+			{
+				const int lower = record.Int32();
+				const int upper = record.Int32();
+				Handle(TDataStd_RealArray) values = TDataStd_RealArray::Set(aLabel, lower, upper);
+				for (int j = lower; j <= upper; j++)
+				{
+					values->SetValue(j, record.Double());
+				}
+			}
+			else if (kind == NamedShapeKind)
+			{
+				// Only the pairs are variable length, so skip over them to find the end
+				const char* begin = record.Take(8);
+				const uint32_t numPairs = record.UInt32();
+				record.Take(8 * static_cast<size_t>(numPairs));
+				namedShapes.push_back({ aLabel, begin, begin + 12 + 8 * static_cast<size_t>(numPairs) });
+			}
+			else if (kind == NamingKind)
+			{
+				// type, shape type, shape, index and orientation, then the labels
+				const char* begin = record.Take(20);
+				for (int path = 0; path < 2; path++)
+				{
+					ReadPath(record, Root);
+				}
+				const uint32_t numArguments = record.UInt32();
+				for (uint32_t j = 0; j < numArguments; j++)
+				{
+					ReadPath(record, Root);
+				}
+				namings.push_back({ aLabel, begin, record.Position() });
+				selections.Add(aLabel);
+			}
+			else
+			{
+				throw std::runtime_error("The history file is truncated or corrupt");
+			}
+		}
+	}
+
+	// Same order TopoNamingHelper built them in: the history first, then the selections,
+	// whose NamedShapes refer to the shapes in it
+	std::vector<PendingAttribute> historyShapes;
+	for (auto&& pending : namedShapes)
+	{
+		bool inSelection = false;
+		for (TDF_Label aLabel = pending.Label; !aLabel.IsNull() && !inSelection; aLabel = aLabel.Father())
+		{
+			inSelection = selections.Contains(aLabel);
+		}
+		(inSelection ? selectionShapes : historyShapes).push_back(pending);
+	}
+	historyShapes.insert(historyShapes.end(), selectionShapes.begin(), selectionShapes.end());
+	for (auto&& pending : historyShapes)
+	{
+		Reader in(pending.Begin, pending.End);
+		const TNaming_Evolution evolution = static_cast<TNaming_Evolution>(in.Int32());
+		const int version = in.Int32();
+		const uint32_t numPairs = in.UInt32();
+		TNaming_Builder Builder(pending.Label);
+		for (uint32_t i = 0; i < numPairs; i++)
+		{
+			const TopoDS_Shape oldShape = shapeOf(in.UInt32());
+			const TopoDS_Shape newShape = shapeOf(in.UInt32());
+			TopoNamingHelper::Replay(Builder, evolution, oldShape, newShape);
+		}
+		Builder.NamedShape()->SetVersion(version);
+	}
+
+	for (auto&& pending : namings)
+	{
+		Reader in(pending.Begin, pending.End);
+		Handle(TNaming_Naming) naming = new TNaming_Naming();
+		pending.Label.AddAttribute(naming);
+		TNaming_Name& name = naming->ChangeName();
+		name.Type(static_cast<TNaming_NameType>(in.Int32()));
+		name.ShapeType(static_cast<TopAbs_ShapeEnum>(in.Int32()));
+		name.Shape(shapeOf(in.UInt32()));
+		name.Index(in.Int32());
+		name.Orientation(static_cast<TopAbs_Orientation>(in.Int32()));
+		name.ContextLabel(ReadPath(in, Root));
+		Handle(TNaming_NamedShape) stopNS;
+		TDF_Label stopLabel = ReadPath(in, Root);
+		if (!stopLabel.IsNull() && stopLabel.FindAttribute(TNaming_NamedShape::GetID(), stopNS))
+		{
+			name.StopNamedShape(stopNS);
+		}
+		const uint32_t numArguments = in.UInt32();
+		for (uint32_t i = 0; i < numArguments; i++)
+		{
+			Handle(TNaming_NamedShape) argument;
+			TDF_Label argumentLabel = ReadPath(in, Root);
+			if (!argumentLabel.IsNull() && argumentLabel.FindAttribute(TNaming_NamedShape::GetID(), argument))
+			{
+				name.Append(argument);
+			}
+		}
+	}
+}
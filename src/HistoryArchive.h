@@ -0,0 +1,50 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef HISTORY_ARCHIVE_H
+#define HISTORY_ARCHIVE_H
+
+#include <string>
+
+#include <TDF_Label.hxx>
+
+// Saves a whole naming history (every label under Root with its text, signatures,
+// TagSources, NamedShapes and Namings, plus all the shapes they use) to one binary file,
+// and reads it back. All numbers are little-endian:
+//
+//     header       "TNHS", uint32 version (1), uint32 number of shapes, uint32 number of
+//                  labels, then uint64 offset and uint64 size of the shape set, uint64
+//                  offset of the shape table and uint64 offset of the labels
+//     shape set    one BinTools_ShapeSet holding every shape, so that a TShape used by
+//                  many NamedShapes is stored (and loaded) once and stays shared
+//     shape table  a uint64 offset per shape, relative to the end of the table, of its
+//                  reference into the shape set (TShape, Location and Orientation)
+//     labels       per label a uint32 byte count, then uint32 depth, int32 tag * depth,
+//                  uint32 number of attributes and the attributes, each starting with a
+//                  one byte kind
+//
+// Shapes in the labels are 1 based indices into the shape table, 0 being a null shape.
+class HistoryArchive
+{
+public:
+	static void Write(const TDF_Label& Root, const std::string& FileName);
+	// Root should be the root of a Data Framework with nothing in it yet. The file is
+	// mapped into memory rather than read. The shape set is read whole before any label,
+	// since its shapes refer to one another, but each shape is only put together from it
+	// the first time a label asks for it.
+	static void Read(const std::string& FileName, const TDF_Label& Root);
+};
+#endif /* ifndef HISTORY_ARCHIVE_H */
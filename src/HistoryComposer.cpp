@@ -0,0 +1,146 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#include "HistoryComposer.h"
+
+void HistoryComposer::AddOperation(const std::vector<Step>& Steps)
+{
+	// Work out everything from the state before this operation, and only then apply it
+	std::vector<TopoDS_Shape> produced;
+	std::unordered_map<TopoDS_Shape, std::vector<Origin>, ShapeHasher, ShapeIsSame> producedFrom;
+	std::vector<TopoDS_Shape> consumed;
+	for (auto&& step : Steps)
+	{
+		if (step.Evolution == TNaming_MODIFY || step.Evolution == TNaming_REPLACE || step.Evolution == TNaming_DELETE)
+		{
+			consumed.push_back(step.OldShape);
+		}
+		if (step.NewShape.IsNull())
+		{
+			continue;
+		}
+
+		std::vector<Origin>& origins = producedFrom[step.NewShape];
+		if (origins.empty())
+		{
+			produced.push_back(step.NewShape);
+		}
+		if (step.Evolution == TNaming_PRIMITIVE || step.OldShape.IsNull())
+		{
+			origins.push_back({ TopoDS_Shape(), TNaming_PRIMITIVE });
+			continue;
+		}
+		const TNaming_Evolution evolution = step.Evolution == TNaming_REPLACE ? TNaming_MODIFY : step.Evolution;
+		auto found = myOrigins.find(step.OldShape);
+		if (found == myOrigins.end())
+		{
+			// Was there before the run started
+			origins.push_back({ step.OldShape, evolution });
+		}
+		else
+		{
+			for (auto&& origin : found->second)
+			{
+				origins.push_back({ origin.Shape, Combine(origin.Evolution, evolution) });
+			}
+		}
+	}
+
+	for (auto&& shape : consumed)
+	{
+		auto found = myOrigins.find(shape);
+		if (found != myOrigins.end())
+		{
+			// Only ever existed in the middle of the run
+			myOrigins.erase(found);
+		}
+		else if (myConsumedSet.insert(shape).second)
+		{
+			myConsumed.push_back(shape);
+		}
+	}
+
+	for (auto&& shape : produced)
+	{
+		std::vector<Origin>& origins = myOrigins[shape];
+		if (origins.empty())
+		{
+			myShapes.push_back(shape);
+		}
+		for (auto&& origin : producedFrom[shape])
+		{
+			bool known = false;
+			for (auto&& existing : origins)
+			{
+				if (existing.Evolution == origin.Evolution && existing.Shape.IsSame(origin.Shape))
+				{
+					known = true;
+					break;
+				}
+			}
+			if (!known)
+			{
+				origins.push_back(origin);
+			}
+		}
+	}
+}
+
+std::vector<HistoryComposer::Step> HistoryComposer::Result() const
+{
+	std::vector<Step> out;
+	std::unordered_set<TopoDS_Shape, ShapeHasher, ShapeIsSame> emitted, survived;
+	for (auto&& shape : myShapes)
+	{
+		auto found = myOrigins.find(shape);
+		// A shape can be in myShapes twice if it was consumed and then produced again
+		if (found == myOrigins.end() || !emitted.insert(shape).second)
+		{
+			continue;
+		}
+		for (auto&& origin : found->second)
+		{
+			out.push_back({ origin.Shape, shape, origin.Evolution });
+			if (origin.Evolution == TNaming_MODIFY)
+			{
+				survived.insert(origin.Shape);
+			}
+		}
+	}
+
+	// Anything that was modified into nothing that's still around is, in the end, deleted
+	for (auto&& shape : myConsumed)
+	{
+		if (survived.count(shape) == 0)
+		{
+			out.push_back({ shape, TopoDS_Shape(), TNaming_DELETE });
+		}
+	}
+	return out;
+}
+
+TNaming_Evolution HistoryComposer::Combine(const TNaming_Evolution& first, const TNaming_Evolution& second)
+{
+	if (first == TNaming_PRIMITIVE)
+	{
+		return TNaming_PRIMITIVE;
+	}
+	if (first == TNaming_GENERATED || second == TNaming_GENERATED)
+	{
+		return TNaming_GENERATED;
+	}
+	return TNaming_MODIFY;
+}
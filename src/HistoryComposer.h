@@ -0,0 +1,68 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef HISTORY_COMPOSER_H
+#define HISTORY_COMPOSER_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <TNaming_Evolution.hxx>
+#include <TopoDS_Shape.hxx>
+
+#include "ShapeHasher.h"
+
+// Works out the net effect of a run of operations, so that the run can be written to
+// the Data Framework as if it had been one single operation. Each operation is given as
+// the (old shape, new shape, evolution) triplets found in its TNaming_NamedShape's.
+class HistoryComposer
+{
+public:
+	struct Step
+	{
+		TopoDS_Shape OldShape;
+		TopoDS_Shape NewShape;
+		TNaming_Evolution Evolution;
+	};
+
+	// Add the next operation of the run. All the Steps of one operation happen at once,
+	// so their order doesn't matter.
+	void AddOperation(const std::vector<Step>& Steps);
+	// The net effect of every operation added so far: a PRIMITIVE, GENERATED or MODIFY
+	// step for each shape that is still around at the end, and a DELETE step for each
+	// shape that was there before the run but isn't any more.
+	std::vector<Step> Result() const;
+
+private:
+	struct Origin
+	{
+		// Null for shapes made from nothing (PRIMITIVE)
+		TopoDS_Shape Shape;
+		TNaming_Evolution Evolution;
+	};
+	// Evolution of old -> newer given that of old -> new and new -> newer
+	static TNaming_Evolution Combine(const TNaming_Evolution& first, const TNaming_Evolution& second);
+
+	// Every shape the run has produced so far, in the order they first showed up
+	std::vector<TopoDS_Shape> myShapes;
+	// Shape produced by the run that's still around -> what it came from before the run
+	std::unordered_map<TopoDS_Shape, std::vector<Origin>, ShapeHasher, ShapeIsSame> myOrigins;
+	// Shapes from before the run that were modified or deleted along the way
+	std::vector<TopoDS_Shape> myConsumed;
+	std::unordered_set<TopoDS_Shape, ShapeHasher, ShapeIsSame> myConsumedSet;
+};
+#endif /* ifndef HISTORY_COMPOSER_H */
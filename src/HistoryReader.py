@@ -0,0 +1,58 @@
+import json, struct
+
+EVOLUTIONS = ['PRIMITIVE', 'GENERATED', 'MODIFY', 'DELETE', 'REPLACE', 'SELECTED']
+
+def readBinary(filename):
+    """Load the output of TopoNamingHelper::ExportBinary as a list of dicts, the same
+    as readNDJSON would give"""
+    records = []
+    with open(filename, 'rb') as infile:
+        data = infile.read()
+    if data[0:4] != b'TNHX':
+        raise ValueError('{} is not a TopoNamingHelper history export'.format(filename))
+    version, = struct.unpack_from('<I', data, 4)
+    if version != 1:
+        raise ValueError('Do not know how to read version {}'.format(version))
+    offset = 8
+    while offset < len(data):
+        length, = struct.unpack_from('<I', data, offset)
+        offset += 4
+        end = offset + length
+
+        depth, = struct.unpack_from('<I', data, offset)
+        offset += 4
+        path = struct.unpack_from('<{}i'.format(depth), data, offset)
+        offset += 4*depth
+        evolution, numShapes = struct.unpack_from('<iI', data, offset)
+        offset += 8
+        ids = struct.unpack_from('<{}I'.format(2*numShapes), data, offset)
+        offset += 8*numShapes
+        textLength, = struct.unpack_from('<I', data, offset)
+        offset += 4
+        text = data[offset:offset + textLength].decode('utf-8', 'replace')
+
+        records.append({'path'      : ':'.join(str(tag) for tag in path),
+                        'evolution' : EVOLUTIONS[evolution] if evolution >= 0 else None,
+                        'shapes'    : [list(ids[i:i+2]) for i in range(0, len(ids), 2)],
+                        'text'      : text})
+        offset = end
+    return records
+
+def readNDJSON(filename):
+    """Load the output of TopoNamingHelper::ExportNDJSON as a list of dicts"""
+    with open(filename, 'r') as infile:
+        return [json.loads(line) for line in infile if line.strip()]
+
+if __name__=='__main__':
+    import sys
+    if len(sys.argv) == 1:
+        print('Please provide at least one file')
+    else:
+        for filename in sys.argv[1:]:
+            with open(filename, 'rb') as infile:
+                isBinary = infile.read(4) == b'TNHX'
+            records = readBinary(filename) if isBinary else readNDJSON(filename)
+            for record in records:
+                indent = '--'*(record['path'].count(':') - 1) if ':' in record['path'] else ''
+                evolution = ', Evolution = {}'.format(record['evolution']) if record['evolution'] else ''
+                print('{}{} {}{}'.format(indent, record['path'], record['text'], evolution))
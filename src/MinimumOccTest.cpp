@@ -43,6 +43,24 @@
 #include <TNaming_UsedShapes.hxx>
 #include <TDF_Tool.hxx>
 #include <TNaming_Selector.hxx>
+#include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRep_Builder.hxx>
+#include <BRep_Tool.hxx>
+#include <Precision.hxx>
+#include <TopoDS_Vertex.hxx>
+#include <TopoDS_Compound.hxx>
+#include <gp_Pln.hxx>
+#include <BRepAlgoAPI_Fuse.hxx>
+#include <BRepAlgoAPI_Cut.hxx>
+#include <BRepAlgoAPI_Common.hxx>
+#include <TopTools_MapOfShape.hxx>
+
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
 
 #define OCCT_DEBUG_NBS
 #define OCCT_DEBUG_CC
@@ -240,6 +258,563 @@ void TestResizeBox()
 	ExportTopoShapeAsSTEP(FilletShape2.GetShape(), Standard_CString("3_ModifiedFillet.step"));
 }
 
+// Stops the run if Condition doesn't hold, and says what was being checked either way
+void Check(const bool& Condition, const std::string& What)
+{
+	if (!Condition)
+	{
+		throw std::runtime_error("FAILED: " + What);
+	}
+	std::clog << "passed: " << What << std::endl;
+}
+
+// Is aLabel Ancestor itself, or somewhere underneath it?
+bool IsUnder(const TDF_Label& aLabel, const TDF_Label& Ancestor)
+{
+	for (TDF_Label curLabel = aLabel; !curLabel.IsNull(); curLabel = curLabel.Father())
+	{
+		if (curLabel.IsEqual(Ancestor))
+		{
+			return true;
+		}
+		if (curLabel.IsRoot())
+		{
+			break;
+		}
+	}
+	return false;
+}
+
+void TestBooleanHistory()
+{
+	// Two boxes that overlap in one corner
+	TopoDS_Shape box1 = BRepPrimAPI_MakeBox(10., 10., 10.);
+	TopoDS_Shape box2 = BRepPrimAPI_MakeBox(gp_Pnt(5., 5., 5.), 10., 10., 10.);
+
+	BRepAlgoAPI_Fuse fuse;
+	BRepAlgoAPI_Cut cut;
+	BRepAlgoAPI_Common common;
+	std::vector<std::pair<BRepAlgoAPI_BooleanOperation*, std::string>> operations = {
+		{ &fuse, "Fuse" }, { &cut, "Cut" }, { &common, "Common" } };
+	for (auto&& operation : operations)
+	{
+		std::clog << "------------------------------" << std::endl;
+		std::clog << "Tracking a " << operation.second << " of two boxes" << std::endl;
+		std::clog << "------------------------------" << std::endl;
+		TopoNamingHelper helper;
+		helper.TrackGeneratedShape(box1, "Box 1");
+		TDF_Label booleanNode = helper.TrackBooleanOperation(*operation.first, { box1 }, { box2 }, operation.second);
+		std::clog << helper.DeepDump2();
+
+		const TopoDS_Shape& result = operation.first->Shape();
+		Check(helper.GetTipShape().IsSame(result), operation.second + " result is the tip shape");
+		Check(helper.FindCreatingNode(result).IsEqual(booleanNode), operation.second + " result was made by the boolean node");
+
+		// Every section edge was generated, from a face of one of the boxes, under the
+		// boolean node. Whichever way round the edge was handed back.
+		TopTools_ListIteratorOfListOfShape sectionIt(operation.first->SectionEdges());
+		Check(sectionIt.More(), operation.second + " has section edges");
+		bool allGenerated = true;
+		for (; sectionIt.More(); sectionIt.Next())
+		{
+			bool generated = false;
+			for (auto&& orientation : { TopAbs_FORWARD, TopAbs_REVERSED })
+			{
+				for (auto&& reference : helper.GetShapeHistory(sectionIt.Value().Oriented(orientation)))
+				{
+					generated = generated || (reference.IsNewShape && reference.Evolution == TNaming_GENERATED &&
+											  IsUnder(reference.Label, booleanNode));
+				}
+			}
+			allGenerated = allGenerated && generated;
+		}
+		Check(allGenerated, operation.second + " section edges are recorded as generated");
+	}
+}
+
+void TestSelectInTwoContexts()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Selecting the same edges in two contexts" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	TopoNamingHelper helper;
+	helper.TrackGeneratedShape(box, "Box");
+
+	// The edges of one face, which are in both the box and the face itself
+	TopTools_IndexedMapOfShape faces, edges;
+	TopExp::MapShapes(box, TopAbs_FACE, faces);
+	TopoDS_Shape face = faces(1);
+	TopExp::MapShapes(face, TopAbs_EDGE, edges);
+	std::vector<TopoDS_Shape> faceEdges;
+	for (int i = 1; i <= edges.Extent(); i++)
+	{
+		faceEdges.push_back(edges(i));
+	}
+
+	std::vector<TDF_Label> inBox = helper.SelectBatch(faceEdges, box);
+	std::vector<TDF_Label> inFace = helper.SelectBatch(faceEdges, face);
+	std::vector<TDF_Label> inBoxAgain = helper.SelectBatch(faceEdges, box);
+	std::vector<TDF_Label> inFaceAgain = helper.SelectBatch(faceEdges, face);
+	std::clog << helper.DeepDump2();
+
+	bool separate = true, reused = true, solved = true;
+	for (size_t i = 0; i < faceEdges.size(); i++)
+	{
+		separate = separate && !inBox[i].IsEqual(inFace[i]);
+		reused = reused && inBox[i].IsEqual(inBoxAgain[i]) && inFace[i].IsEqual(inFaceAgain[i]);
+		solved = solved && helper.GetSelectedEdge(inBox[i]).IsSame(faceEdges[i]) &&
+			helper.GetSelectedEdge(inFace[i]).IsSame(faceEdges[i]);
+	}
+	Check(separate, "a new context gets its own selections");
+	Check(reused, "the same context re-uses the earlier selections");
+	Check(solved, "the selections in both contexts solve to the selected edges");
+}
+
+// DiffShapes(Base, mkShape.Shape()) should come up with NumModified, NumGenerated and
+// NumDeleted faces, and agree with mkShape's own history on which ones
+template <typename Maker>
+void CheckDiffShapes(const TopoDS_Shape& Base, Maker& mkShape, const std::string& Name,
+					 const size_t& NumModified, const size_t& NumGenerated, const size_t& NumDeleted)
+{
+	TopoNamingHelper helper;
+	TopoData diff = helper.DiffShapes(Base, mkShape.Shape());
+	Check(diff.ModifiedFaces.size() == NumModified, Name + ": " + std::to_string(NumModified) + " modified faces");
+	Check(diff.GeneratedFaces.size() == NumGenerated, Name + ": " + std::to_string(NumGenerated) + " generated faces");
+	Check(diff.DeletedFaces.size() == NumDeleted, Name + ": " + std::to_string(NumDeleted) + " deleted faces");
+
+	bool agrees = true;
+	TopTools_MapOfShape images;
+	for (auto&& aPair : diff.ModifiedFaces)
+	{
+		bool found = false;
+		for (TopTools_ListIteratorOfListOfShape it(mkShape.Modified(aPair.first)); it.More(); it.Next())
+		{
+			found = found || it.Value().IsSame(aPair.second);
+			images.Add(it.Value());
+		}
+		agrees = agrees && found;
+	}
+	for (auto&& aFace : diff.DeletedFaces)
+	{
+		agrees = agrees && mkShape.IsDeleted(aFace);
+	}
+	for (auto&& aFace : diff.GeneratedFaces)
+	{
+		agrees = agrees && !images.Contains(aFace);
+	}
+	Check(agrees, Name + ": the faces are the ones " + Name + " itself reports");
+}
+
+void TestDiffShapes()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Diffing shapes against their own history" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+
+	// One rounded edge: its two faces get trimmed and a new one rounds them off
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(box, TopAbs_EDGE, edges);
+	BRepFilletAPI_MakeFillet mkFillet(box);
+	mkFillet.Add(1., TopoDS::Edge(edges(1)));
+	mkFillet.Build();
+	CheckDiffShapes(box, mkFillet, "Fillet", 2, 1, 0);
+
+	// A corner cut out: three faces get notched, and the notch has three faces of its own
+	BRepAlgoAPI_Cut mkCut(box, BRepPrimAPI_MakeBox(gp_Pnt(5., 5., 5.), 10., 10., 10.));
+	CheckDiffShapes(box, mkCut, "Cut", 3, 3, 0);
+}
+
+void TestExports()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Exporting the history" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoNamingHelper helper;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	helper.TrackGeneratedShape(box, "Box");
+	helper.AddNode("A \"quoted\"\nname");
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(box, TopAbs_EDGE, edges);
+	const std::string selectionTag = helper.SelectEdge(TopoDS::Edge(edges(1)), box);
+	std::vector<int> selectionPath;
+	std::istringstream tags(selectionTag);
+	for (std::string tag; std::getline(tags, tag, ':');)
+	{
+		selectionPath.push_back(std::stoi(tag));
+	}
+
+	// One record per label, the Root node included
+	size_t numLabels = 1;
+	for (TDF_ChildIterator it(helper.GetRootNode(), Standard_True); it.More(); it.Next())
+	{
+		numLabels++;
+	}
+	size_t numRecords = 0;
+	helper.ForEachHistoryRecord([&numRecords](const HistoryRecord&) { numRecords++; });
+	Check(numRecords == numLabels, "there is a record for every label");
+
+	std::ostringstream binary;
+	helper.ExportBinary(binary);
+	const std::string bytes = binary.str();
+	auto getUInt = [&bytes](size_t offset)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			value |= static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + i])) << (8 * i);
+		}
+		return value;
+	};
+	Check(bytes.size() >= 8 && bytes.compare(0, 4, "TNHX") == 0 && getUInt(4) == 1, "the binary export starts with the magic and version 1");
+	size_t offset = 8, binaryRecords = 0;
+	bool binarySelected = false;
+	while (offset + 4 <= bytes.size())
+	{
+		// Each record starts with its depth and tags, then the evolution
+		const size_t depth = getUInt(offset + 4);
+		std::vector<int> path;
+		for (size_t i = 0; i < depth; i++)
+		{
+			path.push_back(static_cast<int32_t>(getUInt(offset + 8 + 4 * i)));
+		}
+		if (path == selectionPath)
+		{
+			binarySelected = static_cast<int32_t>(getUInt(offset + 8 + 4 * depth)) == TNaming_SELECTED;
+		}
+		offset += 4 + getUInt(offset);
+		binaryRecords++;
+	}
+	Check(offset == bytes.size() && binaryRecords == numRecords, "the binary export is every record, back to back");
+	Check(binarySelected, "the binary export has the selection as TNaming_SELECTED");
+
+	std::ostringstream ndjson;
+	helper.ExportNDJSON(ndjson);
+	std::istringstream lines(ndjson.str());
+	std::string line;
+	size_t jsonRecords = 0;
+	bool wellFormed = true, jsonSelected = false;
+	const std::string selectionStart = "{\"path\":\"" + selectionTag + "\",\"evolution\":\"SELECTED\"";
+	while (std::getline(lines, line))
+	{
+		wellFormed = wellFormed && line.compare(0, 9, "{\"path\":\"") == 0 && line.back() == '}';
+		jsonSelected = jsonSelected || line.compare(0, selectionStart.size(), selectionStart) == 0;
+		jsonRecords++;
+	}
+	Check(wellFormed && jsonRecords == numRecords, "the NDJSON export is one object per line, newlines in the text and all");
+	Check(jsonSelected, "the NDJSON export has the selection as \"evolution\":\"SELECTED\"");
+}
+
+// Whether two edges, possibly made of different TShapes, start and end in the same place
+bool SameEnds(const TopoDS_Edge& anEdge, const TopoDS_Edge& anotherEdge)
+{
+	if (anEdge.IsNull() || anotherEdge.IsNull())
+	{
+		return false;
+	}
+	TopoDS_Vertex first, last, otherFirst, otherLast;
+	TopExp::Vertices(anEdge, first, last);
+	TopExp::Vertices(anotherEdge, otherFirst, otherLast);
+	return BRep_Tool::Pnt(first).Distance(BRep_Tool::Pnt(otherFirst)) < Precision::Confusion() &&
+		BRep_Tool::Pnt(last).Distance(BRep_Tool::Pnt(otherLast)) < Precision::Confusion();
+}
+
+void TestSaveLoad()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Saving and loading the history" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoNamingHelper helper;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	helper.TrackGeneratedShape(box, "Box");
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(box, TopAbs_EDGE, edges);
+	const std::string selectionTag = helper.SelectEdge(TopoDS::Edge(edges(1)), box);
+	TopoDS_Shape tallBox = BRepPrimAPI_MakeBox(10., 10., 20.);
+	TopoData TData = helper.DiffShapes(box, tallBox);
+	TData.OldShape = box;
+	helper.TrackModifiedShape(tallBox, TData, "Resized box");
+
+	const std::string fileName = "TestSaveLoad.tnhs";
+	helper.Save(fileName);
+	TopoNamingHelper loaded;
+	loaded.Load(fileName);
+	std::remove(fileName.c_str());
+
+	Check(loaded.DeepDump2() == helper.DeepDump2(), "the loaded history has the same labels");
+	// The loaded shapes are new TShapes, so they can only be the same in where they are
+	Check(SameEnds(loaded.GetSelectedEdge(selectionTag), helper.GetSelectedEdge(selectionTag)),
+		  "the selection solves to the same edge after loading");
+}
+
+void TestUndoRedo()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Undoing and redoing" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	TopoDS_Shape tallBox = BRepPrimAPI_MakeBox(10., 10., 20.);
+	TopoNamingHelper helper;
+	Check(!helper.Undo() && !helper.Redo(), "there is nothing to undo or redo at first");
+	helper.TrackGeneratedShape(box, "Box");
+	helper.TrackGeneratedShape(tallBox, "Tall box");
+
+	Check(helper.Undo() && helper.GetTipShape().IsSame(box), "undo takes the last shape back off");
+	Check(helper.CanRedo(), "what was undone can be redone");
+	Check(helper.Redo() && helper.GetTipShape().IsSame(tallBox), "redo puts it back");
+	Check(!helper.Redo(), "there is nothing left to redo");
+
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(tallBox, TopAbs_EDGE, edges);
+	const std::string selectionTag = helper.SelectEdge(TopoDS::Edge(edges(1)), tallBox);
+	Check(helper.Undo() && helper.SelectEdge(TopoDS::Edge(edges(2)), tallBox) == selectionTag,
+		  "a selection is undone like anything else, so its label gets used again");
+
+	helper.AddNode("Tracked Shape");
+	TDF_TagSource::NewChild(helper.GetSelectionNode());
+	Check(!helper.Undo() && !helper.CanUndo(), "a label added outside of a transaction drops the undo steps");
+}
+
+void TestUndoLimits()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Limiting the undo steps" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoNamingHelper helper;
+	std::vector<TopoDS_Shape> boxes;
+	for (int i = 0; i < 5; i++)
+	{
+		boxes.push_back(BRepPrimAPI_MakeBox(10., 10., 10. + i));
+		helper.TrackGeneratedShape(boxes.back(), "Box");
+	}
+
+	// A fork with no undo steps at all, that hasn't made its own copy of the history yet
+	TopoNamingHelper forked = helper.Fork();
+	forked.SetUndoLimits(0, 0);
+	forked.AddNode("Only in the fork");
+	Check(!forked.CanUndo(), "the fork keeps no undo steps");
+
+	helper.SetUndoLimits(2, 1 << 16);
+	Check(helper.Undo() && helper.Undo(), "the original keeps two undo steps, whatever the fork does");
+	Check(!helper.Undo() && helper.GetTipShape().IsSame(boxes[2]), "and only two");
+}
+
+void TestCompact()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Compacting a history of resized boxes" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoNamingHelper helper;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	helper.TrackGeneratedShape(box, "Box");
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(box, TopAbs_EDGE, edges);
+	const std::string selectionTag = helper.SelectEdge(TopoDS::Edge(edges(1)), box);
+
+	// Four resizes, of which the middle three can be collapsed into one
+	TopoDS_Shape current = box;
+	for (int i = 1; i <= 4; i++)
+	{
+		TopoDS_Shape resized = BRepPrimAPI_MakeBox(10., 10., 10. + i);
+		TopoData TData = helper.DiffShapes(current, resized);
+		TData.OldShape = current;
+		helper.TrackModifiedShape(resized, TData, "Resized box");
+		current = resized;
+	}
+
+	// A fifth resize, undone again, which mustn't shuffle the order the box was recorded
+	// in: made first, selected from second (tag order would have the selection first)
+	TopoDS_Shape undone = BRepPrimAPI_MakeBox(10., 10., 20.);
+	TopoData TData = helper.DiffShapes(current, undone);
+	TData.OldShape = current;
+	helper.TrackModifiedShape(undone, TData, "Resized box");
+	Check(helper.Undo(), "the fifth resize is undone");
+	auto recordedInOrder = [&helper, &box]()
+	{
+		std::vector<ShapeReference> history = helper.GetShapeHistory(box);
+		return history.size() == 2 && history.front().Evolution == TNaming_PRIMITIVE && history.back().Evolution == TNaming_SELECTED;
+	};
+	Check(recordedInOrder(), "undoing keeps the history in the order it was recorded");
+
+	const TopoDS_Shape solvedBefore = helper.GetSelectedEdge(selectionTag);
+	Check(helper.CanUndo(), "there is something to undo before compacting");
+
+	Check(helper.Compact() == 2, "the middle three resizes collapse into one node");
+	Check(!helper.CanUndo(), "compacting drops the undo steps");
+	Check(recordedInOrder(), "compacting after an undo keeps the history in the order it was recorded");
+	Check(!solvedBefore.IsNull() && helper.GetSelectedEdge(selectionTag).IsSame(solvedBefore),
+		  "the selection solves to the same edge after compacting");
+}
+
+void TestFork()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Forking a history" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	TopoDS_Shape tallBox = BRepPrimAPI_MakeBox(10., 10., 20.);
+	TopoNamingHelper original;
+	original.TrackGeneratedShape(box, "Box");
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(box, TopAbs_EDGE, edges);
+	const std::string selectionTag = TopoNamingHelper::GetTag(original.SelectBatch({ edges(1) }, box).front());
+	const std::string before = original.DeepDump2();
+
+	// A plain copy is the same history
+	TopoNamingHelper alias(original);
+	TopoNamingHelper forked = original.Fork();
+	Check(forked.DeepDump2() == before, "a fork starts out with the same history");
+
+	forked.TrackGeneratedShape(tallBox, "Tall box");
+	Check(original.DeepDump2() == before, "changing the fork leaves the original alone");
+	Check(forked.GetTipShape().IsSame(tallBox), "the fork has its own change");
+
+	const std::string forkedBefore = forked.DeepDump2();
+	alias.AddNode("Only in the original");
+	Check(original.DeepDump2() != before, "a copy changes the history it was copied from");
+	Check(forked.DeepDump2() == forkedBefore, "changing the original leaves the fork alone");
+
+	Check(original.GetSelectedEdge(selectionTag).IsSame(edges(1)) && forked.GetSelectedEdge(selectionTag).IsSame(edges(1)),
+		  "a selection made before forking solves the same in both");
+}
+
+void TestAppendHistory()
+{
+	std::clog << "------------------------------" << std::endl;
+	std::clog << "Appending one history to another" << std::endl;
+	std::clog << "------------------------------" << std::endl;
+	TopoDS_Shape box = BRepPrimAPI_MakeBox(10., 10., 10.);
+	TopoDS_Shape tallBox = BRepPrimAPI_MakeBox(10., 10., 20.);
+	TopoNamingHelper base;
+	base.TrackGeneratedShape(box, "Box");
+
+	TopoNamingHelper source = base.Fork();
+	source.TrackGeneratedShape(tallBox, "Tall box");
+	TopoNamingHelper target = base.Fork();
+	Check(!target.AppendTopoHistory("0", base, "0"), "there is nothing to append from the same history");
+	Check(target.AppendTopoHistory("0", source, "0"), "the newer history is appended");
+	Check(target.DeepDump2() == source.DeepDump2(), "every node under the appended one is copied");
+	Check(target.GetTipShape().IsSame(tallBox), "the appended node has the shape");
+
+	TopTools_IndexedMapOfShape edges;
+	TopExp::MapShapes(tallBox, TopAbs_EDGE, edges);
+	std::vector<TDF_Label> selected = target.SelectBatch({ edges(1) }, tallBox);
+	Check(target.GetSelectedEdge(selected.front()).IsSame(edges(1)), "the appended shapes can be selected and solved");
+}
+
+// Times the first change to a fork, which copies the whole Data Framework, for a
+// growing number of operations in the history
+void BenchmarkFork()
+{
+	std::vector<int> operationCounts = { 10, 100, 1000 };
+	for (auto&& numOperations : operationCounts)
+	{
+		TopoNamingHelper helper;
+		for (int i = 0; i < numOperations; i++)
+		{
+			helper.TrackGeneratedShape(BRepPrimAPI_MakeBox(10., 10., 10. + i), "Box");
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		TopoNamingHelper forked = helper.Fork();
+		auto forkedAt = std::chrono::steady_clock::now();
+		forked.AddNode("First change");
+		auto stop = std::chrono::steady_clock::now();
+
+		double forkMs = std::chrono::duration<double, std::milli>(forkedAt - start).count();
+		double changeMs = std::chrono::duration<double, std::milli>(stop - forkedAt).count();
+		std::clog << std::setw(6) << numOperations << " operations: "
+				  << std::setw(10) << forkMs << " ms to fork, "
+				  << std::setw(10) << changeMs << " ms for the first change" << std::endl;
+	}
+}
+
+// Times TrackGeneratedShape for a growing number of faces, to make sure that recording
+// the generated faces scales linearly.
+void BenchmarkGeneratedNodes()
+{
+	std::vector<int> faceCounts = { 6, 60, 600, 6000, 50000 };
+	for (auto&& numFaces : faceCounts)
+	{
+		// Each face is a separate unit square, stacked in Z, so that every one of them
+		// is a distinct TopoDS_TShape
+		TopoData TData;
+		TopoDS_Compound compound;
+		BRep_Builder builder;
+		builder.MakeCompound(compound);
+		TData.GeneratedFaces.reserve(numFaces);
+		for (int i = 0; i < numFaces; i++)
+		{
+			gp_Pln plane(gp_Pnt(0., 0., i), gp_Dir(0., 0., 1.));
+			TopoDS_Face face = BRepBuilderAPI_MakeFace(plane, 0., 1., 0., 1.);
+			builder.Add(compound, face);
+			TData.GeneratedFaces.push_back(face);
+		}
+
+		TopoNamingHelper helper;
+		helper.AddNode("Tracked Shape");
+
+		auto start = std::chrono::steady_clock::now();
+		helper.TrackGeneratedShape("0:2", compound, TData, "Generated Faces Benchmark");
+		auto stop = std::chrono::steady_clock::now();
+
+		double totalMs = std::chrono::duration<double, std::milli>(stop - start).count();
+		std::clog << std::setw(6) << numFaces << " faces: "
+				  << std::setw(10) << totalMs << " ms total, "
+				  << std::setw(8) << (totalMs * 1000. / numFaces) << " us/face" << std::endl;
+	}
+}
+
+// Compares looking up the same tags over and over through the TopoNamingHelper tag
+// cache against walking the tree with TDF_Tool::Label every time.
+void BenchmarkTagLookup()
+{
+	const int depth = 12;
+	const int branches = 4;
+	const int repeats = 1000;
+
+	TopoNamingHelper helper;
+	std::vector<std::string> tags;
+	for (int b = 0; b < branches; b++)
+	{
+		TDF_Label curLabel = helper.GetRootNode();
+		for (int d = 0; d < depth; d++)
+		{
+			curLabel = TDF_TagSource::NewChild(curLabel);
+			tags.push_back(TopoNamingHelper::GetTag(curLabel));
+		}
+	}
+
+	Handle(TDF_Data) data = helper.GetRootNode().Data();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeats; i++)
+	{
+		for (auto&& tag : tags)
+		{
+			TDF_Label outLabel;
+			TDF_Tool::Label(data, tag.c_str(), outLabel);
+		}
+	}
+	auto stop = std::chrono::steady_clock::now();
+	double toolMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeats; i++)
+	{
+		for (auto&& tag : tags)
+		{
+			helper.GetLabel(tag);
+		}
+	}
+	stop = std::chrono::steady_clock::now();
+	double cacheMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+	std::clog << tags.size() * repeats << " lookups, up to " << depth << " levels deep" << std::endl;
+	std::clog << "TDF_Tool::Label: " << toolMs << " ms" << std::endl;
+	std::clog << "tag cache:       " << cacheMs << " ms" << std::endl;
+}
+
 void runCase3()
 {
 	// This is for the Data Framework
@@ -1283,12 +1858,30 @@ void runCase4()
 	TDF_Tool::DeepDump(std::cout, DF);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
 	//TestMkFillet();
 
 	TestResizeBox();
-
+	TestBooleanHistory();
+	TestSelectInTwoContexts();
+	TestDiffShapes();
+	TestExports();
+	TestSaveLoad();
+	TestUndoRedo();
+	TestUndoLimits();
+	TestCompact();
+	TestFork();
+	TestAppendHistory();
+
+	// The benchmarks take a while and their timings drown out the test results, so they
+	// only run when asked for, i.e. "MinimumOccTest --benchmark"
+	if (argc > 1 && std::string(argv[1]) == "--benchmark")
+	{
+		BenchmarkGeneratedNodes();
+		BenchmarkTagLookup();
+		BenchmarkFork();
+	}
 	//runCase3();
 	//runCase4();
 	return 0;
@@ -0,0 +1,122 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef OPERATION_TRAITS_H
+#define OPERATION_TRAITS_H
+
+class BRepFilletAPI_MakeFillet;
+class BRepFilletAPI_MakeChamfer;
+class BRepPrimAPI_MakePrism;
+class BRepPrimAPI_MakeRevol;
+class BRepOffsetAPI_MakeOffsetShape;
+class BRepAlgoAPI_BooleanOperation;
+class BRepAlgoAPI_Cut;
+class BRepAlgoAPI_Fuse;
+class BRepAlgoAPI_Common;
+
+// The different kinds of history a BRepBuilderAPI_MakeShape can report. The bit
+// position plus one is also the tag of the sub-node the history is stored under (see
+// HistoryKindTag and TopoNamingHelper::TrackOperation)
+enum OperationHistoryKind
+{
+	HistoryModified     = 1 << 0,
+	HistoryDeleted      = 1 << 1,
+	HistoryFromEdges    = 1 << 2,
+	HistoryFromVertices = 1 << 3,
+	HistoryFromFaces    = 1 << 4,
+	HistoryAll          = (1 << 5) - 1
+};
+
+// The tag of the sub-node that the history of Kind (a single OperationHistoryKind) is
+// stored under: 1 for HistoryModified, 2 for HistoryDeleted and so on.
+// NOTE: this is one more than the tags TrackFilletOperation used to write (0 for the
+// modified faces up to 3 for the faces from vertices), so a fillet node's sub-nodes
+// are now 1..4. Tag 0 is outside of what the TagSource hands out, so CountChildren and
+// GetNodeLabel never saw those sub-nodes. Anything reading the old tags (nothing in
+// this tree does) has to add one.
+inline int HistoryKindTag(const int& Kind)
+{
+	int tag = 1;
+	for (int bits = Kind; bits > 1; bits >>= 1)
+	{
+		tag++;
+	}
+	return tag;
+}
+
+// Which history queries are worth asking a given Maker. Anything not listed here is
+// known to always come back empty for that Maker, so TrackOperation doesn't ask it and
+// doesn't make a sub-node for it. Makers without a specialization get asked everything.
+// A Maker without HistoryModified doesn't modify its base shape either, so its result
+// is recorded as generated from the base shape instead.
+template <typename Maker>
+struct OperationTraits
+{
+	static const int Kinds = HistoryAll;
+};
+
+template <>
+struct OperationTraits<BRepFilletAPI_MakeFillet>
+{
+	static const int Kinds = HistoryModified | HistoryDeleted | HistoryFromEdges | HistoryFromVertices;
+};
+
+template <>
+struct OperationTraits<BRepFilletAPI_MakeChamfer>
+{
+	static const int Kinds = HistoryModified | HistoryDeleted | HistoryFromEdges | HistoryFromVertices;
+};
+
+// Sweeps never modify or delete anything, they only generate: Faces from Edges, Edges
+// from Vertexes and Solids (plus the end caps) from Faces
+template <>
+struct OperationTraits<BRepPrimAPI_MakePrism>
+{
+	static const int Kinds = HistoryFromEdges | HistoryFromVertices | HistoryFromFaces;
+};
+
+template <>
+struct OperationTraits<BRepPrimAPI_MakeRevol>
+{
+	static const int Kinds = HistoryFromEdges | HistoryFromVertices | HistoryFromFaces;
+};
+
+template <>
+struct OperationTraits<BRepOffsetAPI_MakeOffsetShape>
+{
+	static const int Kinds = HistoryModified | HistoryDeleted | HistoryFromEdges | HistoryFromVertices;
+};
+
+// Booleans modify and delete Faces, and generate section Edges from intersecting Faces
+// (and Vertexes from Edges). Nothing is ever generated from a Vertex.
+template <>
+struct OperationTraits<BRepAlgoAPI_BooleanOperation>
+{
+	static const int Kinds = HistoryModified | HistoryDeleted | HistoryFromEdges | HistoryFromFaces;
+};
+
+template <>
+struct OperationTraits<BRepAlgoAPI_Cut> : OperationTraits<BRepAlgoAPI_BooleanOperation>
+{};
+
+template <>
+struct OperationTraits<BRepAlgoAPI_Fuse> : OperationTraits<BRepAlgoAPI_BooleanOperation>
+{};
+
+template <>
+struct OperationTraits<BRepAlgoAPI_Common> : OperationTraits<BRepAlgoAPI_BooleanOperation>
+{};
+#endif /* ifndef OPERATION_TRAITS_H */
@@ -0,0 +1,228 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#include <algorithm>
+#include <cmath>
+
+#include <BRepBndLib.hxx>
+#include <Precision.hxx>
+
+#include "ShapeBVH.h"
+
+namespace
+{
+	Bnd_Box BoxOf(const TopoDS_Shape& aShape)
+	{
+		Bnd_Box aBox;
+		BRepBndLib::Add(aShape, aBox);
+		aBox.Enlarge(Precision::Confusion());
+		return aBox;
+	}
+
+	gp_XYZ CenterOf(const Bnd_Box& aBox)
+	{
+		if (aBox.IsVoid())
+		{
+			return gp_XYZ();
+		}
+		double xMin, yMin, zMin, xMax, yMax, zMax;
+		aBox.Get(xMin, yMin, zMin, xMax, yMax, zMax);
+		return gp_XYZ(0.5 * (xMin + xMax), 0.5 * (yMin + yMax), 0.5 * (zMin + zMax));
+	}
+}
+
+ShapeBVH::ShapeBVH(const TopTools_IndexedMapOfShape& Shapes)
+{
+	myBoxes.reserve(Shapes.Extent());
+	for (int i = 1; i <= Shapes.Extent(); i++)
+	{
+		myBoxes.push_back(BoxOf(Shapes(i)));
+	}
+	this->Build();
+}
+
+ShapeBVH::ShapeBVH(const TopTools_IndexedMapOfShape& Shapes, const ShapeBVH& Previous, const TopTools_IndexedMapOfShape& PreviousShapes)
+{
+	myBoxes.resize(Shapes.Extent());
+	bool sameLayout = Shapes.Extent() == Previous.Size();
+	std::vector<int> changed;
+	for (int i = 1; i <= Shapes.Extent(); i++)
+	{
+		const int j = PreviousShapes.FindIndex(Shapes(i));
+		if (j > 0 && j <= Previous.Size())
+		{
+			myBoxes[i - 1] = Previous.Box(j);
+			sameLayout = sameLayout && i == j;
+		}
+		else
+		{
+			myBoxes[i - 1] = BoxOf(Shapes(i));
+			changed.push_back(i - 1);
+		}
+	}
+
+	if (sameLayout)
+	{
+		myNodes = Previous.myNodes;
+		myLeaves = Previous.myLeaves;
+		this->Refit(changed);
+	}
+	else
+	{
+		this->Build();
+	}
+}
+
+ShapeBVH::ShapeBVH(const std::vector<Bnd_Box>& Boxes) : myBoxes(Boxes)
+{
+	this->Build();
+}
+
+std::vector<int> ShapeBVH::Intersecting(const Bnd_Box& aBox) const
+{
+	std::vector<int> found;
+	if (myNodes.empty())
+	{
+		return found;
+	}
+
+	std::vector<int> stack(1, 0);
+	while (!stack.empty())
+	{
+		const Node& aNode = myNodes[stack.back()];
+		stack.pop_back();
+		if (aNode.Box.IsOut(aBox))
+		{
+			continue;
+		}
+		if (aNode.Right < 0)
+		{
+			found.push_back(aNode.Left + 1);
+		}
+		else
+		{
+			stack.push_back(aNode.Left);
+			stack.push_back(aNode.Right);
+		}
+	}
+	return found;
+}
+
+double ShapeBVH::Distance(const gp_Pnt& aPoint, const Bnd_Box& aBox)
+{
+	if (aBox.IsVoid())
+	{
+		return RealLast();
+	}
+	double lower[3], upper[3];
+	aBox.Get(lower[0], lower[1], lower[2], upper[0], upper[1], upper[2]);
+	double squareDistance = 0.;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const double coord = aPoint.Coord(axis + 1);
+		const double outside = std::max(0., std::max(lower[axis] - coord, coord - upper[axis]));
+		squareDistance += outside * outside;
+	}
+	return std::sqrt(squareDistance);
+}
+
+void ShapeBVH::Build()
+{
+	myNodes.clear();
+	myLeaves.assign(myBoxes.size(), -1);
+	if (myBoxes.empty())
+	{
+		return;
+	}
+	myNodes.reserve(2 * myBoxes.size() - 1);
+	myOrder.resize(myBoxes.size());
+	for (size_t i = 0; i < myOrder.size(); i++)
+	{
+		myOrder[i] = static_cast<int>(i);
+	}
+	this->BuildNode(0, static_cast<int>(myOrder.size()), -1);
+	myOrder.clear();
+	myOrder.shrink_to_fit();
+}
+
+int ShapeBVH::BuildNode(const int& first, const int& last, const int& parent)
+{
+	const int index = static_cast<int>(myNodes.size());
+	myNodes.push_back(Node());
+	myNodes[index].Parent = parent;
+
+	if (last - first == 1)
+	{
+		const int shape = myOrder[first];
+		myNodes[index].Box = myBoxes[shape];
+		myNodes[index].Left = shape;
+		myNodes[index].Right = -1;
+		myLeaves[shape] = index;
+		return index;
+	}
+
+	// Split at the median of the box centres, along whichever axis they're most spread out
+	gp_XYZ lower(RealLast(), RealLast(), RealLast());
+	gp_XYZ upper(RealFirst(), RealFirst(), RealFirst());
+	for (int i = first; i < last; i++)
+	{
+		const gp_XYZ center = CenterOf(myBoxes[myOrder[i]]);
+		for (int axis = 1; axis <= 3; axis++)
+		{
+			lower.SetCoord(axis, std::min(lower.Coord(axis), center.Coord(axis)));
+			upper.SetCoord(axis, std::max(upper.Coord(axis), center.Coord(axis)));
+		}
+	}
+	const gp_XYZ spread = upper - lower;
+	int splitAxis = 1;
+	if (spread.Y() > spread.Coord(splitAxis))
+	{
+		splitAxis = 2;
+	}
+	if (spread.Z() > spread.Coord(splitAxis))
+	{
+		splitAxis = 3;
+	}
+	const int middle = first + (last - first) / 2;
+	std::nth_element(myOrder.begin() + first, myOrder.begin() + middle, myOrder.begin() + last, [&](const int& a, const int& b)
+	{
+		return CenterOf(myBoxes[a]).Coord(splitAxis) < CenterOf(myBoxes[b]).Coord(splitAxis);
+	});
+
+	const int left = this->BuildNode(first, middle, index);
+	const int right = this->BuildNode(middle, last, index);
+	Node& aNode = myNodes[index];
+	aNode.Left = left;
+	aNode.Right = right;
+	aNode.Box = myNodes[left].Box;
+	aNode.Box.Add(myNodes[right].Box);
+	return index;
+}
+
+void ShapeBVH::Refit(const std::vector<int>& changed)
+{
+	for (auto&& shape : changed)
+	{
+		int index = myLeaves[shape];
+		myNodes[index].Box = myBoxes[shape];
+		for (index = myNodes[index].Parent; index >= 0; index = myNodes[index].Parent)
+		{
+			Node& aNode = myNodes[index];
+			aNode.Box = myNodes[aNode.Left].Box;
+			aNode.Box.Add(myNodes[aNode.Right].Box);
+		}
+	}
+}
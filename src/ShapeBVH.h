@@ -0,0 +1,110 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef SHAPE_BVH_H
+#define SHAPE_BVH_H
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <Bnd_Box.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <gp_Pnt.hxx>
+
+// A bounding volume hierarchy over the Bnd_Box of every shape in a
+// TopTools_IndexedMapOfShape (i.e. the Faces or Edges of a TopologyIndex). Shapes are
+// referred to by their (1 based) index in that map.
+class ShapeBVH
+{
+public:
+	explicit ShapeBVH(const TopTools_IndexedMapOfShape& Shapes);
+	// Same as above, but any shape that's also in PreviousShapes re-uses its box from
+	// Previous instead of having it recomputed. If nothing moved around in the map, the
+	// tree itself is kept and just refit around the boxes that changed.
+	ShapeBVH(const TopTools_IndexedMapOfShape& Shapes, const ShapeBVH& Previous, const TopTools_IndexedMapOfShape& PreviousShapes);
+	// Build directly from boxes, Boxes[n - 1] being the box of shape n
+	explicit ShapeBVH(const std::vector<Bnd_Box>& Boxes);
+
+	int Size() const { return static_cast<int>(myBoxes.size()); }
+	const Bnd_Box& Box(const int& n) const { return myBoxes[n - 1]; }
+
+	// Indices of every shape whose box intersects aBox
+	std::vector<int> Intersecting(const Bnd_Box& aBox) const;
+	// Call visit(n, distance) for the shapes in order of increasing distance from aPoint
+	// to their box. Stops as soon as visit returns false, so a caller looking for the
+	// nearest anything can stop once distance is more than the best it has found.
+	template <typename Visitor>
+	void VisitNearest(const gp_Pnt& aPoint, Visitor&& visit) const;
+
+	// Distance from aPoint to aBox, zero if it's inside
+	static double Distance(const gp_Pnt& aPoint, const Bnd_Box& aBox);
+
+private:
+	struct Node
+	{
+		Bnd_Box Box;
+		// Children for an inner node. For a leaf, Right is -1 and Left is the 0 based
+		// index of the shape
+		int Left;
+		int Right;
+		int Parent;
+	};
+
+	void Build();
+	int BuildNode(const int& first, const int& last, const int& parent);
+	// Recompute the boxes of every node above the leaves of the given shapes (0 based)
+	void Refit(const std::vector<int>& changed);
+
+	std::vector<Bnd_Box> myBoxes;
+	std::vector<Node> myNodes;
+	// node holding each shape
+	std::vector<int> myLeaves;
+	// scratch space for Build: shape indices, reordered as the tree is split
+	std::vector<int> myOrder;
+};
+
+template <typename Visitor>
+void ShapeBVH::VisitNearest(const gp_Pnt& aPoint, Visitor&& visit) const
+{
+	if (myNodes.empty())
+	{
+		return;
+	}
+
+	// Best first: always open up whichever node is closest
+	typedef std::pair<double, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	queue.emplace(Distance(aPoint, myNodes[0].Box), 0);
+	while (!queue.empty())
+	{
+		const Entry current = queue.top();
+		queue.pop();
+		const Node& aNode = myNodes[current.second];
+		if (aNode.Right < 0)
+		{
+			if (!visit(aNode.Left + 1, current.first))
+			{
+				return;
+			}
+			continue;
+		}
+		queue.emplace(Distance(aPoint, myNodes[aNode.Left].Box), aNode.Left);
+		queue.emplace(Distance(aPoint, myNodes[aNode.Right].Box), aNode.Right);
+	}
+}
+#endif /* ifndef SHAPE_BVH_H */
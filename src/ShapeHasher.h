@@ -0,0 +1,117 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef SHAPE_HASHER_H
+#define SHAPE_HASHER_H
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include <Standard_Integer.hxx>
+#include <TopoDS_Shape.hxx>
+
+// Hash and equality functors so that TopoDS_Shape can be used as a key in the std
+// unordered containers. TopoDS_Shape::HashCode only looks at the TShape and the
+// Location, so the same hash works for both the IsSame and the IsEqual flavour.
+struct ShapeHasher
+{
+	std::size_t operator()(const TopoDS_Shape& aShape) const
+	{
+		return static_cast<std::size_t>(aShape.HashCode(IntegerLast()));
+	}
+};
+
+// Same TShape and same Location, orientation is ignored
+struct ShapeIsSame
+{
+	bool operator()(const TopoDS_Shape& shape1, const TopoDS_Shape& shape2) const
+	{
+		return shape1.IsSame(shape2);
+	}
+};
+
+// Same TShape, Location and Orientation
+struct ShapeIsEqual
+{
+	bool operator()(const TopoDS_Shape& shape1, const TopoDS_Shape& shape2) const
+	{
+		return shape1.IsEqual(shape2);
+	}
+};
+
+// A cache of something worked out per shape (same TShape and Location), that holds on
+// to at most Capacity of them. Once it's full, the one that was used the longest time
+// ago makes way for the new one. NOTE: not thread safe, not even Find.
+template <typename Value>
+class ShapeLRUCache
+{
+public:
+	explicit ShapeLRUCache(const size_t& Capacity) : myCapacity(Capacity)
+	{}
+
+	// The cached value for aShape, or nullptr. A hit counts as a use.
+	const Value* Find(const TopoDS_Shape& aShape)
+	{
+		auto found = myLookup.find(aShape);
+		if (found == myLookup.end())
+		{
+			return nullptr;
+		}
+		myEntries.splice(myEntries.begin(), myEntries, found->second);
+		return &found->second->second;
+	}
+
+	// Cache aValue for aShape, replacing whatever was there
+	const Value& Insert(const TopoDS_Shape& aShape, Value aValue)
+	{
+		auto found = myLookup.find(aShape);
+		if (found != myLookup.end())
+		{
+			myEntries.erase(found->second);
+			myLookup.erase(found);
+		}
+		myEntries.emplace_front(aShape, std::move(aValue));
+		myLookup.emplace(aShape, myEntries.begin());
+		while (myEntries.size() > myCapacity)
+		{
+			myLookup.erase(myEntries.back().first);
+			myEntries.pop_back();
+		}
+		return myEntries.front().second;
+	}
+
+	void Clear()
+	{
+		myLookup.clear();
+		myEntries.clear();
+	}
+
+	size_t Size() const
+	{
+		return myEntries.size();
+	}
+
+private:
+	typedef std::list<std::pair<TopoDS_Shape, Value>> EntryList;
+
+	size_t myCapacity;
+	// most recently used first
+	EntryList myEntries;
+	std::unordered_map<TopoDS_Shape, typename EntryList::iterator, ShapeHasher, ShapeIsSame> myLookup;
+};
+#endif /* ifndef SHAPE_HASHER_H */
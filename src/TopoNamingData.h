@@ -19,6 +19,8 @@
 
 #include <vector>
 #include <array>
+#include <string>
+#include <utility>
 #include <TopoDS_Shape.hxx>
 #include <TopoDS_Face.hxx>
 #include <TopoDS_Edge.hxx>
@@ -73,6 +75,33 @@ struct FilletData : TopoData
     std::vector< std::pair<TopoDS_Vertex, TopoDS_Face>> GeneratedFacesFromVertex;
 };
 
+// The history reported by a BRepBuilderAPI_MakeShape for a single operation. This is
+// collected first, and then written to the Data Framework all at once.
+struct OperationHistory{
+    // (old Face, new Face)
+    std::vector<std::pair<TopoDS_Shape, TopoDS_Shape>> ModifiedFaces;
+    std::vector<TopoDS_Shape> DeletedFaces;
+    // (Edge, generated Shape)
+    std::vector<std::pair<TopoDS_Shape, TopoDS_Shape>> GeneratedFromEdges;
+    // (Vertex, generated Shape)
+    std::vector<std::pair<TopoDS_Shape, TopoDS_Shape>> GeneratedFromVertices;
+    // (Face, generated Shape)
+    std::vector<std::pair<TopoDS_Shape, TopoDS_Shape>> GeneratedFromFaces;
+};
+
+// One label of a TopoNamingHelper's history, see TopoNamingHelper::ForEachHistoryRecord.
+// Shapes are given as ids that are only unique within one walk over the history: the
+// same TShape and Location always gets the same id, and 0 means no shape.
+struct HistoryRecord{
+    // Tags from the Root node down, i.e. {0, 2, 1} for "0:2:1"
+    std::vector<int> Path;
+    // A TNaming_Evolution, or -1 if the label doesn't have a NamedShape
+    int Evolution = -1;
+    // (old shape id, new shape id) for each pair in the NamedShape
+    std::vector<std::pair<unsigned int, unsigned int>> Shapes;
+    std::string Text;
+};
+
 struct BoxData{
     BoxData(double height, double length, double width){
         Height = height;
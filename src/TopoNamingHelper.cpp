@@ -1,7 +1,21 @@
 #include <vector>
+#include <algorithm>
+#include <tuple>
+#include <cmath>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+#include <queue>
+#include <functional>
 
 #include <Geom_Plane.hxx>
 #include <GeomAPI_ProjectPointOnCurve.hxx>
+#include <GeomAdaptor_Curve.hxx>
+#include <ElCLib.hxx>
+#include <gp_Circ.hxx>
+#include <gp_Elips.hxx>
 #include <Geom_Line.hxx>
 #include <Precision.hxx>
 
@@ -11,14 +25,31 @@
 #include <TDF_Tool.hxx>
 #include <TDF_ChildIterator.hxx>
 #include <TDF_LabelMap.hxx>
+#include <TDF_LabelIntegerMap.hxx>
+#include <TDF_AttributeMap.hxx>
+#include <TDF_MapIteratorOfAttributeMap.hxx>
+#include <TDF_AttributeIterator.hxx>
+#include <TDF_Delta.hxx>
+#include <TDF_AttributeDelta.hxx>
+#include <TDF_ListIteratorOfAttributeDeltaList.hxx>
+#include <TDF_RelocationTable.hxx>
 
 #include "TopoNamingHelper.h"
+#include "TopoNamingLog.h"
+#include "HistoryComposer.h"
+#include "HistoryArchive.h"
+#include "GeometricSignature.h"
+#include "ShapeBVH.h"
 
 #include <TopTools_IndexedMapOfShape.hxx>
 #include <TopTools_ListOfShape.hxx>
 #include <TopTools_ListIteratorOfListOfShape.hxx>
 
 #include <TopExp.hxx>
+#include <Bnd_Box.hxx>
+#include <BRepBndLib.hxx>
+#include <BRepBuilderAPI_MakeVertex.hxx>
+#include <BRepExtrema_DistShapeShape.hxx>
 
 #include <TopoDS.hxx>
 #include <TopoDS_Face.hxx>
@@ -28,6 +59,8 @@
 #include <TNaming_NamedShape.hxx>
 #include <TNaming_UsedShapes.hxx>
 #include <TNaming_Tool.hxx>
+#include <TNaming_Iterator.hxx>
+#include <TNaming_Naming.hxx>
 
 #include <BRepTools.hxx>
 #include <BRep_Tool.hxx>
@@ -42,15 +75,13 @@
 
 TopoNamingHelper::TopoNamingHelper()
 {
-	mySelectionNode = TDF_TagSource::NewChild(myRootNode);
-	AddTextToLabel(mySelectionNode, "Selection Root Node");
+	myHistory->State->SelectionNode = this->NewChild(myHistory->State->RootNode);
+	AddTextToLabel(myHistory->State->SelectionNode, "Selection Root Node");
 }
 
-TopoNamingHelper::TopoNamingHelper(const TopoNamingHelper& existing)
+TopoNamingHelper::TopoNamingHelper(const TopoNamingHelper& existing) : myHistory(existing.myHistory)
 {
-	this->myDataFramework = existing.myDataFramework;
-	this->myRootNode = existing.myRootNode;
-	this->mySelectionNode = existing.mySelectionNode;
+	// NOTE: this shares the history with existing, see Fork for a separate one
 }
 
 TopoNamingHelper::~TopoNamingHelper()
@@ -59,274 +90,207 @@ TopoNamingHelper::~TopoNamingHelper()
 void TopoNamingHelper::operator = (const TopoNamingHelper& helper)
 {
 	//std::clog << "----------Setting operator = TopoNaming stuff\n";
-	this->myDataFramework = helper.myDataFramework;
-	this->myRootNode = helper.myRootNode;
-	this->mySelectionNode = helper.mySelectionNode;
+	this->myHistory = helper.myHistory;
+}
+
+TopoNamingHelper TopoNamingHelper::Fork() const
+{
+	// Same State for now, but a History of its own, so that EnsureUnshared can tell the
+	// State is shared and swap in a copy for whichever one writes first.
+	TopoNamingHelper forked(*this);
+	forked.myHistory = std::make_shared<TopoNamingHistory>(*myHistory);
+	return forked;
+}
+
+TDF_Label TopoNamingHelper::GetRootNode()
+{
+	this->EnsureUnshared();
+	return myHistory->State->RootNode;
+}
+
+TDF_Label TopoNamingHelper::GetSelectionNode()
+{
+	this->EnsureUnshared();
+	return myHistory->State->SelectionNode;
 }
 
 void TopoNamingHelper::TrackGeneratedShape(const TopoDS_Shape& GeneratedShape, const std::string& name)
 {
+	Transaction transaction(*this);
 	TopoData FaceData;
 
-	TopTools_IndexedMapOfShape mapOfFaces;
-	TopExp::MapShapes(GeneratedShape, TopAbs_FACE, mapOfFaces);
+	std::shared_ptr<const TopologyIndex> shapeIndex = this->GetTopologyIndex(GeneratedShape);
+	const TopTools_IndexedMapOfShape& mapOfFaces = shapeIndex->Faces();
 	for (int i = 1; i <= mapOfFaces.Extent(); i++)
 	{
 		TopoDS_Face curFace = TopoDS::Face(mapOfFaces.FindKey(i));
 		FaceData.GeneratedFaces.push_back(curFace);
 	}
-	this->TrackGeneratedShape("0", GeneratedShape, FaceData, name);
+	this->TrackGeneratedShape(myHistory->State->RootNode, GeneratedShape, FaceData, name);
+	transaction.Commit();
 }
 
 void TopoNamingHelper::TrackGeneratedShape(const TopoDS_Shape& GeneratedShape, const TopoData& TData, const std::string& name)
 {
-	this->TrackGeneratedShape("0", GeneratedShape, TData, name);
+	Transaction transaction(*this);
+	this->TrackGeneratedShape(myHistory->State->RootNode, GeneratedShape, TData, name);
+	transaction.Commit();
 }
 
 TDF_Label TopoNamingHelper::TrackGeneratedShape(const std::string& parent_tag, const TopoDS_Shape& GeneratedShape,
 												const TopoData& TData, const std::string& name)
 {
+	Transaction transaction(*this);
+	TDF_Label LabelRoot = this->TrackGeneratedShape(this->LabelFromTag(parent_tag), GeneratedShape, TData, name);
+	transaction.Commit();
+	return LabelRoot;
+}
+
+TDF_Label TopoNamingHelper::TrackGeneratedShape(const TDF_Label& parent, const TopoDS_Shape& GeneratedShape,
+												const TopoData& TData, const std::string& name)
+{
+	Transaction transaction(*this);
 	//std::clog << "----------Tracking Generated Shape\n";
 	//std::ostringstream outputStream;
 	//DeepDump(outputStream);
 	//Base::Console().Message(outputStream.str().c_str());
 	// Declare variables
-	TDF_Label parent = this->LabelFromTag(parent_tag);
 	TDF_Label curLabel;
 
 	// create a new node under Parent
-	TDF_Label LabelRoot = TDF_TagSource::NewChild(parent);
+	TDF_Label LabelRoot = this->NewChild(parent);
 
 	AddTextToLabel(LabelRoot, name);
 
 	// add the generated shape to the LabelRoot
 	TNaming_Builder GeneratedBuilder(LabelRoot);
 	GeneratedBuilder.Generated(GeneratedShape);
+	this->IndexNamedShape(LabelRoot);
 	this->MakeGeneratedNodes(LabelRoot, TData.GeneratedFaces);
 
 	//std::clog << "----------Data Framework Dump Below from TopoNamingHelper\n";
 	//std::clog << this->DeepDump();
+	transaction.Commit();
 	return LabelRoot;
 }
 
 TDF_Label TopoNamingHelper::TrackGeneratedShape(const std::string& parent_tag, const TopoDS_Shape& GeneratedShape,
 												const FilletData& FData, const std::string& name)
 {
+	Transaction transaction(*this);
 	TDF_Label LabelRoot = this->TrackGeneratedShape(parent_tag, GeneratedShape, TopoData(FData), name);
 	this->MakeGeneratedFromEdgeNodes(LabelRoot, FData.GeneratedFacesFromEdge);
 	this->MakeGeneratedFromVertexNodes(LabelRoot, FData.GeneratedFacesFromVertex);
+	transaction.Commit();
 	return LabelRoot;
 }
 
-//void TopoNamingHelper::TrackFuseOperation(BRepAlgoAPI_Fuse& Fuser){
-	////std::clog << "----------Tracking Fuse Operation\n";
-	//// TODO: Need to update to account for an abritrary number of shapes being fused.
-	//// In a Fuse operation, each face is either Modified from one of the -two- (scratch
-	//// that) 'many' Shapes being fused, or it is Deleted. There is not an instance where a
-	//// Fuse operation results in a Generated Face.
-	//TopoDS_Shape BaseShape   = Fuser.Shape1();
-	//TopoDS_Shape FuseShape   = Fuser.Shape2();
-	//TopoDS_Shape ResultShape = Fuser.Shape();
-
-	////TopTools_ListOfShape 
-
-	//// create two new nodes under Root. The first is to track the 'Shape1' as a
-	//// 'Generated' shape, and the second is to track the ResultShape, with  sub-nodes for
-	//// the modified faces on the BaseShape and the 'Shape1' as well. TODO: Need to figure
-	//// out a way to incorporate the topo tree from Shape1 into our topo tree, if Shape1
-	//// has one.
-	////std::clog << "----------Note: next 'tracking generated shape' msg from TrackFuseOperation\n";
-	//this->TrackGeneratedShape(FuseShape);
-	//TDF_Label LabelRoot    = TDF_TagSource::NewChild(myRootNode);
-	//TDF_Label BaseModified = TDF_TagSource::NewChild(LabelRoot);
-	//TDF_Label FuseModified = TDF_TagSource::NewChild(LabelRoot);
-
-	//// Add some descriptive text for debugging
-	//AddTextToLabel(LabelRoot, "Fusion Node");
-	//AddTextToLabel(BaseModified, "Modified Faces on Base Shape");
-	//AddTextToLabel(FuseModified, "Modified Faces on Add Shape");
-
-	//// Add the fused shape as a modification of BaseShape
-	//TNaming_Builder ResultBuilder(LabelRoot);
-	//ResultBuilder.Modify(BaseShape, ResultShape);
-
-	//// Add the BaseShape modified faces and the FuseShape modified faces
-	//TNaming_Builder BaseModifiedBuilder(BaseModified);
-	//TNaming_Builder FuseModifiedBuilder(FuseModified);
-
-	//TopTools_IndexedMapOfShape origFaces, fuseFaces, allBaseModified;
-
-	//TopExp::MapShapes(BaseShape, TopAbs_FACE, origFaces);
-	//for (int i=1; i<=origFaces.Extent(); i++){
-		//TopoDS_Face curFace = TopoDS::Face(origFaces.FindKey(i));
-		//TopTools_ListOfShape modified = Fuser.Modified(curFace);
-		//TopTools_ListIteratorOfListOfShape modIterator(modified);
-		//for (; modIterator.More(); modIterator.Next()){
-			//TopoDS_Face moddedFace = TopoDS::Face(modIterator.Value());
-			//if (!curFace.IsEqual(moddedFace)){
-				//BaseModifiedBuilder.Modify(curFace, moddedFace);
-				//allBaseModified.Add(moddedFace);
-			//}
-		//}
-	//}
-
-	//TopExp::MapShapes(FuseShape, TopAbs_FACE, fuseFaces);
-	//for (int i=1; i<=fuseFaces.Extent(); i++){
-		//TopoDS_Face curFace = TopoDS::Face(fuseFaces.FindKey(i));
-		//TopTools_ListOfShape modified = Fuser.Modified(curFace);
-		//TopTools_ListIteratorOfListOfShape modIterator(modified);
-		//for (; modIterator.More(); modIterator.Next()){
-			//TopoDS_Face moddedFace = TopoDS::Face(modIterator.Value());
-			//if (!curFace.IsEqual(moddedFace) && !allBaseModified.Contains(moddedFace)){
-				//FuseModifiedBuilder.Modify(curFace, moddedFace);
-			//}
-		//}
-	//}
-	////std::ostringstream outputStream;
-	////DeepDump(outputStream);
-	//////std::clog << "----------Data Framework Dump Below\n";
-	////Base::Console().Message(outputStream.str().c_str());
-//}
-
-void TopoNamingHelper::TrackFilletOperation(const TopoDS_Shape& BaseShape, TopoDS_Shape& ResultShape, BRepFilletAPI_MakeFillet& Filleter)
+TDF_Label TopoNamingHelper::TrackBooleanOperation(BRepAlgoAPI_BooleanOperation& Operator, const std::vector<TopoDS_Shape>& Arguments,
+												  const std::vector<TopoDS_Shape>& Tools, const std::string& name)
 {
-	//BRepFilletAPI_MakeFillet Filleter = mkFillet;
-	//std::clog << "----------Tracking Fillet Operation\n";
-	//std::ostringstream output;
-	//DeepDump(output);
-	//Base::Console().Message(output.str().c_str());
-
-	//TopoDS_Shape ResultShape = mkFillet.Shape();
-
-	// Create a new node under the Root node for the result filleted Shape and it's
-	// modified/deleted/generated Faces.
-	//TDF_Label FilletRoot = TDF_TagSource::NewChild(myRootNode);
-	//TDF_Label Modified = TDF_TagSource::NewChild(FilletRoot);
-	//TDF_Label Deleted = TDF_TagSource::NewChild(FilletRoot);
-	//TDF_Label FacesFromEdges = TDF_TagSource::NewChild(FilletRoot);
-	//TDF_Label FacesFromVertices = TDF_TagSource::NewChild(FilletRoot);
-
-	TDF_Label FilletRootLabel = TDF_TagSource::NewChild(myRootNode);
-	TDF_Label ModifiedFacesLabel = FilletRootLabel.FindChild(0);
-	TDF_Label DeletedFacesLabel = FilletRootLabel.FindChild(1);
-	TDF_Label FacesFromEdgesLabel = FilletRootLabel.FindChild(2);
-	TDF_Label FacesFromVerticesLabel = FilletRootLabel.FindChild(3);
-
-	// Add some descriptive text for debugging
-	AddTextToLabel(FilletRootLabel, "Fillet Node");
-	AddTextToLabel(ModifiedFacesLabel, "Modified faces");
-	AddTextToLabel(DeletedFacesLabel, "Deleted faces");
-	AddTextToLabel(FacesFromEdgesLabel, "Faces from edges");
-	AddTextToLabel(FacesFromVerticesLabel, "Faces from vertices");
-
-	// Start by adding the result shape. This will also create the TNaming_UsedShapes
-	// under the Root node if it doesn't exist
-	TNaming_Builder FilletBuilder(FilletRootLabel);
-	FilletBuilder.Modify(BaseShape, ResultShape);
-
-	// Next, the Faces generated from Edges
-	//TNaming_Builder FacesFromEdgeBuilder(FacesFromEdges);
-	TopTools_IndexedMapOfShape mapOfEdges;
-	TopExp::MapShapes(BaseShape, TopAbs_EDGE, mapOfEdges);
-	std::cout << "Edges count: " << mapOfEdges.Extent() << std::endl;
-	for (int i = 1; i <= mapOfEdges.Extent(); i++)
-	{
-		const TopoDS_Edge& curEdge = TopoDS::Edge(mapOfEdges.FindKey(i));
-		const TopTools_ListOfShape& generatedFaces = Filleter.Generated(curEdge);
-		TopTools_ListIteratorOfListOfShape it(generatedFaces);
-		for (; it.More(); it.Next())
-		{
-			const TopoDS_Shape& checkShape = it.Value();
-			if (!curEdge.IsSame(checkShape))
-			{
-				TDF_Label label = TDF_TagSource::NewChild(FacesFromEdgesLabel);
-				AddTextToLabel(label, "Face generated from Edge");
-				TNaming_Builder FacesFromEdgeBuilder(label);
-				FacesFromEdgeBuilder.Generated(curEdge, checkShape);
-			}
-		}
+	Transaction transaction(*this);
+	if (Arguments.empty() || Tools.empty())
+	{
+		throw std::runtime_error("A boolean operation needs at least one argument and one tool");
 	}
 
-	// Faces from BaseShape Modified or Deleted by the Fillet operation    
-	TopTools_IndexedMapOfShape mapOfFaces;
-	TopExp::MapShapes(BaseShape, TopAbs_FACE, mapOfFaces);
-	for (int i = 1; i <= mapOfFaces.Extent(); i++)
+	TopTools_ListOfShape argumentList, toolList;
+	for (auto&& anArgument : Arguments)
 	{
-		const TopoDS_Face& curFace = TopoDS::Face(mapOfFaces.FindKey(i));
-
-		// First check Modified
-		const TopTools_ListOfShape& modifiedFaces = Filleter.Modified(curFace);
-		TopTools_ListIteratorOfListOfShape it(modifiedFaces);
-		for (; it.More(); it.Next())
-		{
-			const TopoDS_Shape& checkShape = it.Value();
-			if (!curFace.IsSame(checkShape))
-			{
-				TDF_Label label = TDF_TagSource::NewChild(ModifiedFacesLabel);
-				AddTextToLabel(label, "Modified face");
-				TNaming_Builder ModifiedBuilder(label);
-				ModifiedBuilder.Modify(curFace, checkShape);
-			}
-		}
+		argumentList.Append(anArgument);
+	}
+	for (auto&& aTool : Tools)
+	{
+		toolList.Append(aTool);
+	}
 
-		// Then check Deleted
-		if (Filleter.IsDeleted(curFace))
-		{
-			TDF_Label label = TDF_TagSource::NewChild(DeletedFacesLabel);
-			AddTextToLabel(label, "Deleted face");
-			TNaming_Builder DeletedBuilder(ModifiedFacesLabel);
-			DeletedBuilder.Delete(curFace);
-		}
+	Operator.SetArguments(argumentList);
+	Operator.SetTools(toolList);
+	Operator.SetRunParallel(Standard_True);
+	Operator.Build();
+	if (!Operator.IsDone())
+	{
+		throw std::runtime_error("The boolean operation failed, nothing was tracked");
+	}
+	const TopoDS_Shape& ResultShape = Operator.Shape();
+
+	// Gather the history of every argument and tool before writing anything
+	std::vector<TopoDS_Shape> inputs(Arguments);
+	inputs.insert(inputs.end(), Tools.begin(), Tools.end());
+	std::vector<OperationHistory> histories;
+	histories.reserve(inputs.size());
+	for (auto&& anInput : inputs)
+	{
+		histories.push_back(this->GatherHistory(anInput, Operator));
 	}
 
-	// Finally, the Faces generated from Vertices
-	TopTools_IndexedMapOfShape mapOfVertices;
-	TopExp::MapShapes(BaseShape, TopAbs_VERTEX, mapOfVertices);
-	for (int i = 1; i <= mapOfVertices.Extent(); i++)
+	// The result is a modification of the first argument. Underneath it goes one node per
+	// argument and one per tool holding its own history. The section edges are in there
+	// too, as shapes generated from the faces that intersect.
+	TDF_Label BooleanRootLabel = this->NewChild(myHistory->State->RootNode);
+	AddTextToLabel(BooleanRootLabel, name);
+	TNaming_Builder ResultBuilder(BooleanRootLabel);
+	ResultBuilder.Modify(Arguments.front(), ResultShape);
+	this->IndexNamedShape(BooleanRootLabel);
+	this->CarryOverTopologyIndex(Arguments.front(), ResultShape);
+
+	std::vector<TDF_Label> inputLabels = this->NewChildren(BooleanRootLabel, inputs.size());
+	for (size_t i = 0; i < inputLabels.size(); i++)
 	{
-		const TopoDS_Shape& curVertex = mapOfVertices.FindKey(i);
-		const TopTools_ListOfShape& generatedFaces = Filleter.Generated(curVertex);
-		TopTools_ListIteratorOfListOfShape it(generatedFaces);
-		for (; it.More(); it.Next())
+		std::ostringstream inputName;
+		if (i < Arguments.size())
 		{
-			const TopoDS_Shape& checkShape = it.Value();
-			if (!curVertex.IsSame(checkShape))
-			{
-				TDF_Label label = TDF_TagSource::NewChild(FacesFromVerticesLabel);
-				AddTextToLabel(label, "Generated face");
-				TNaming_Builder ModifiedBuilder(label);
-				ModifiedBuilder.Generated(curVertex, checkShape);
-			}
+			inputName << "Argument " << (i + 1);
 		}
+		else
+		{
+			inputName << "Tool " << (i - Arguments.size() + 1);
+		}
+		AddTextToLabel(inputLabels[i], inputName.str());
+		this->WriteHistory(inputLabels[i], histories[i], OperationTraits<BRepAlgoAPI_BooleanOperation>::Kinds);
 	}
+	transaction.Commit();
+	return BooleanRootLabel;
+}
 
-	//std::ostringstream outputStream;    
-	//std::clog << "----------Data Framework Dump Below\n";
-	//std::clog << DeepDump2() << std::endl;
-	//std::clog << outputStream.str() << "\n";
-	//Base::Console().Message(outputStream.str().c_str());
+void TopoNamingHelper::TrackFilletOperation(const TopoDS_Shape& BaseShape, TopoDS_Shape& ResultShape, BRepFilletAPI_MakeFillet& Filleter)
+{
+	Transaction transaction(*this);
+	TN_LOG_DEBUG(TopoNamingLog::Tracking, "Edges count: " << this->GetTopologyIndex(BaseShape)->Edges().Extent());
+	OperationHistory history = this->GatherHistory(BaseShape, Filleter);
+	this->CommitHistory(BaseShape, ResultShape, history, OperationTraits<BRepFilletAPI_MakeFillet>::Kinds, "Fillet Node");
+	transaction.Commit();
 }
 
 void TopoNamingHelper::TrackModifiedShape(const TopoDS_Shape& NewShape, const TopoData& TData, const std::string& name)
 {
-	std::ostringstream tipTagStream;
-	tipTagStream << "0:" << this->myRootNode.NbChildren();
-	this->TrackModifiedShape(tipTagStream.str(), NewShape, TData, name);
+	Transaction transaction(*this);
+	this->TrackModifiedShape(this->GetNodeLabel(CountChildren(this->myHistory->State->RootNode)), NewShape, TData, name);
+	transaction.Commit();
 }
 
 void TopoNamingHelper::TrackModifiedShape(const std::string& OrigShapeNodeTag, const TopoDS_Shape& NewShape,
 										  const TopoData& TData, const std::string& name)
 {
+	Transaction transaction(*this);
+	this->TrackModifiedShape(this->LabelFromTag(OrigShapeNodeTag), NewShape, TData, name);
+	transaction.Commit();
+}
+
+void TopoNamingHelper::TrackModifiedShape(const TDF_Label& OrigNode, const TopoDS_Shape& NewShape,
+										  const TopoData& TData, const std::string& name)
+{
+	Transaction transaction(*this);
 	// NOTE: This method assumes that the NewShape has NOT been translated. If it has, the
 	// behaviour of the topological naming algorithm is not defined, it will probably fail
-	TDF_Label OrigNode = this->LabelFromTag(OrigShapeNodeTag);
 
 	if (!OrigNode.IsNull())
 	{
 		// create new node for modified shape and sub-nodes. Even if there are no
 		// Modified/Generated/Deleted Faces, we'll still create the node so we know what's
 		// where.
-		TDF_Label NewNode = TDF_TagSource::NewChild(myRootNode);
+		TDF_Label NewNode = this->NewChild(myHistory->State->RootNode);
+		this->CarryOverTopologyIndex(TData.OldShape, NewShape);
 
 		// Add descriptive data for debugging purposes
 		AddTextToLabel(NewNode, name);
@@ -334,25 +298,25 @@ void TopoNamingHelper::TrackModifiedShape(const std::string& OrigShapeNodeTag, c
 		// Create subnodes for appropriate Topo Data and Builders, but only if necessary
 		if (TData.GeneratedFaces.size() > 0)
 		{
-			TDF_Label Generated = TDF_TagSource::NewChild(NewNode);
+			TDF_Label Generated = this->NewChild(NewNode);
 			AddTextToLabel(Generated, "Generated faces");
 			this->MakeGeneratedNodes(Generated, TData.GeneratedFaces);
 		}
 
 		if (TData.ModifiedFaces.size() > 0)
 		{
-			TDF_Label Modified = TDF_TagSource::NewChild(NewNode);
+			TDF_Label Modified = this->NewChild(NewNode);
 			AddTextToLabel(Modified, "Modified faces");
 			this->MakeModifiedNodes(Modified, TData.ModifiedFaces);
 		}
 
 		if (TData.DeletedFaces.size() > 0)
 		{
-			TDF_Label Deleted = TDF_TagSource::NewChild(NewNode);
+			TDF_Label Deleted = this->NewChild(NewNode);
 			AddTextToLabel(Deleted, "Deleted faces");
 			this->MakeDeletedNodes(Deleted, TData.DeletedFaces);
 		}
-
+		transaction.Commit();
 	}
 	else
 	{
@@ -369,30 +333,49 @@ void TopoNamingHelper::TrackModifiedFilletBaseShape(const TopoDS_Shape& NewBaseS
 
 std::string TopoNamingHelper::SelectEdge(const TopoDS_Edge& anEdge, const TopoDS_Shape& aShape)
 {
+	// NOTE: the checks below only read, so they come before the Transaction. That way a
+	// fork doesn't copy its history just to hand back a selection it already has.
+
+	// Cheap check first: have we already made a selection of exactly this edge, in this
+	// same context? One made in another context still refers to that one, so it won't do.
+	TDF_Label ExistingLabel = this->FindSelection(myHistory->State->SelectionNode, anEdge, aShape);
+	if (!ExistingLabel.IsNull())
+	{
+		TN_LOG_DEBUG(TopoNamingLog::Selection, "----------Selection already exists, returning existing selection...");
+		return GetTag(ExistingLabel);
+	}
+
+	// IsIdentified turns up earlier selections of anEdge too, but those are only any good
+	// in the same context, which FindSelection has already looked for
 	Handle(TNaming_NamedShape) EdgeNS;
-	bool identified = TNaming_Selector::IsIdentified(mySelectionNode, anEdge, EdgeNS);
+	bool identified = TNaming_Selector::IsIdentified(myHistory->State->SelectionNode, anEdge, EdgeNS) &&
+		EdgeNS->Evolution() != TNaming_SELECTED;
 
 	std::ostringstream dumpedEntry;
 	if (!identified)
 	{
-		std::clog << "----------Creating selection (did not exist)...\n";
-		const TDF_Label SelectedLabel = TDF_TagSource::NewChild(mySelectionNode);
+		TN_LOG_DEBUG(TopoNamingLog::Selection, "----------Creating selection (did not exist)...");
+		Transaction transaction(*this);
+		const TDF_Label SelectedLabel = this->NewChild(myHistory->State->SelectionNode);
 		TNaming_Selector SelectionBuilder(SelectedLabel);
 		bool check = SelectionBuilder.Select(anEdge, aShape);
 		if (check)
 		{
-			std::clog << "----------Selection \x1B[32mWAS\033[0m succesfull" << std::endl;
+			TN_LOG_DEBUG(TopoNamingLog::Selection, "----------Selection WAS succesfull");
 		}
 		else
 		{
-			std::clog << "----------Selection WAS \x1B[31mNOT\033[0m suffesfull" << std::endl;
+			TN_LOG_WARNING(TopoNamingLog::Selection, "----------Selection WAS NOT succesfull");
 		}
 		this->AddTextToLabel(SelectedLabel, "A selected edge. Sub-node is the context Shape");
+		this->StoreSelectionSignature(SelectedLabel, anEdge, aShape);
+		this->IndexNamedShape(SelectedLabel);
+		transaction.Commit();
 		SelectedLabel.EntryDump(dumpedEntry);
 	}
 	else
 	{
-		std::clog << "----------Node existing, returning existing selection...\n";
+		TN_LOG_DEBUG(TopoNamingLog::Selection, "----------Node existing, returning existing selection...");
 		const TDF_Label SelectedLabel = EdgeNS->Label();
 		SelectedLabel.EntryDump(dumpedEntry);
 	}
@@ -402,7 +385,7 @@ std::string TopoNamingHelper::SelectEdge(const TopoDS_Edge& anEdge, const TopoDS
 
 std::string TopoNamingHelper::SelectEdge(const TopoDS_Edge& anEdge, const TopoDS_Shape& aShape, TNaming_Selector& selector, TDF_Label& selectionLabel)
 {
-	std::clog << "-> Selecting edge with pre-existing selector." << std::endl;
+	TN_LOG_DEBUG(TopoNamingLog::Selection, "-> Selecting edge with pre-existing selector.");
 	Handle(TNaming_NamedShape) EdgeNS;
 	std::ostringstream dumpedEntry;
 
@@ -418,56 +401,145 @@ std::string TopoNamingHelper::SelectEdge(const TopoDS_Edge& anEdge, const TopoDS
 	//    return "";
 	//}
 
-	std::clog << "----------Select edge using passed selector...\n";
-	bool check = selector.Select(anEdge, aShape);
+	TN_LOG_DEBUG(TopoNamingLog::Selection, "----------Select edge using passed selector...");
+	Transaction transaction(*this);
+	const TDF_Label relocatedLabel = this->Relocate(selectionLabel);
+	bool check;
+	if (relocatedLabel.IsEqual(selectionLabel))
+	{
+		check = selector.Select(anEdge, aShape);
+	}
+	else
+	{
+		// selector writes to the Data Framework that this helper was forked from
+		selectionLabel = relocatedLabel;
+		TNaming_Selector relocatedSelector(selectionLabel);
+		check = relocatedSelector.Select(anEdge, aShape);
+	}
 	if (check)
 	{
-		std::clog << "----------Selection \x1B[32mWAS\033[0m succesfull" << std::endl;
+		TN_LOG_DEBUG(TopoNamingLog::Selection, "----------Selection WAS succesfull");
 	}
 	else
 	{
-		std::clog << "----------Selection WAS \x1B[31mNOT\033[0m suffesfull" << std::endl;
+		TN_LOG_WARNING(TopoNamingLog::Selection, "----------Selection WAS NOT succesfull");
 	}
 	this->AddTextToLabel(selectionLabel, "A selected edge. Sub-node is the context Shape");
+	this->StoreSelectionSignature(selectionLabel, anEdge, aShape);
+	this->IndexNamedShape(selectionLabel);
 	selectionLabel.EntryDump(dumpedEntry);
 
+	transaction.Commit();
 	return dumpedEntry.str();
 }
 
 std::vector<std::string> TopoNamingHelper::SelectEdges(const std::vector<TopoDS_Edge> Edges,
 													   const TopoDS_Shape& aShape)
 {
+	std::vector<TopoDS_Shape> SubShapes(Edges.begin(), Edges.end());
 	std::vector<std::string> outputLabels;
-	for (std::vector<TopoDS_Edge>::const_iterator it = Edges.begin(); it != Edges.end(); ++it)
+	outputLabels.reserve(SubShapes.size());
+	for (auto&& aLabel : this->SelectBatch(SubShapes, aShape))
+	{
+		outputLabels.push_back(GetTag(aLabel));
+	}
+	return outputLabels;
+}
+
+std::vector<TDF_Label> TopoNamingHelper::SelectBatch(const std::vector<TopoDS_Shape>& SubShapes, const TopoDS_Shape& Context)
+{
+	std::vector<TDF_Label> outputLabels(SubShapes.size());
+	std::shared_ptr<const TopologyIndex> contextIndex = this->GetTopologyIndex(Context);
+
+	// First pass: figure out which of the SubShapes already have a selection in Context,
+	// either from an earlier call or from earlier on in this same batch, or are
+	// identified by the history as they are (same as SelectEdge).
+	std::unordered_map<TopoDS_Shape, size_t, ShapeHasher, ShapeIsEqual> newSelections;
+	std::vector<size_t> toSelect;
+	for (size_t i = 0; i < SubShapes.size(); i++)
+	{
+		const TopoDS_Shape& aShape = SubShapes[i];
+		if (!contextIndex->Map(aShape.ShapeType()).Contains(aShape))
+		{
+			throw std::runtime_error("Can only select sub-shapes that are part of the Context Shape");
+		}
+
+		TDF_Label existing = this->FindSelection(myHistory->State->SelectionNode, aShape, Context);
+		Handle(TNaming_NamedShape) ShapeNS;
+		if (!existing.IsNull())
+		{
+			outputLabels[i] = existing;
+		}
+		else if (TNaming_Selector::IsIdentified(myHistory->State->SelectionNode, aShape, ShapeNS) &&
+				 ShapeNS->Evolution() != TNaming_SELECTED)
+		{
+			outputLabels[i] = ShapeNS->Label();
+		}
+		else if (newSelections.find(aShape) == newSelections.end())
+		{
+			newSelections.emplace(aShape, toSelect.size());
+			toSelect.push_back(i);
+		}
+	}
+
+	// Only now is there anything to write. If this helper is a fork, starting the
+	// Transaction may copy the history, which the labels found so far have to follow.
+	if (toSelect.empty())
+	{
+		return outputLabels;
+	}
+	Transaction transaction(*this);
+	for (auto&& aLabel : outputLabels)
+	{
+		aLabel = this->Relocate(aLabel);
+	}
+
+	// Second pass: make all of the new selections, with their labels allocated in one go
+	std::vector<TDF_Label> newLabels = this->NewChildren(myHistory->State->SelectionNode, toSelect.size());
+	for (size_t i = 0; i < toSelect.size(); i++)
 	{
-		TopoDS_Edge curEdge = *it;
-		std::string curLabelEntry = this->SelectEdge(curEdge, aShape);
-		outputLabels.push_back(curLabelEntry);
+		const TDF_Label& SelectedLabel = newLabels[i];
+		TNaming_Selector SelectionBuilder(SelectedLabel);
+		if (!SelectionBuilder.Select(SubShapes[toSelect[i]], Context))
+		{
+			TN_LOG_WARNING(TopoNamingLog::Selection, "----------Selection of " << GetTag(SelectedLabel) << " WAS NOT successful");
+		}
+		this->AddTextToLabel(SelectedLabel, "A selected shape. Sub-node is the context Shape");
+		this->StoreSelectionSignature(SelectedLabel, SubShapes[toSelect[i]], Context);
+		this->IndexNamedShape(SelectedLabel);
+	}
+
+	// Finally, hand every sub-shape its label, in the same order they were passed in
+	for (size_t i = 0; i < SubShapes.size(); i++)
+	{
+		if (outputLabels[i].IsNull())
+		{
+			outputLabels[i] = newLabels[newSelections[SubShapes[i]]];
+		}
 	}
+	transaction.Commit();
 	return outputLabels;
 }
 bool TopoNamingHelper::AppendTopoHistory(const std::string& BaseRoot, const TopoNamingHelper& InputData, const std::string& InputTargetNode)
 {
 	TDF_Label BaseNode = this->LabelFromTag(BaseRoot);
 	TDF_Label BaseInput = InputData.LabelFromTag(InputTargetNode);
-	if (BaseInput.NbChildren() - BaseNode.NbChildren() <= 0)
+	if (CountChildren(BaseInput) - CountChildren(BaseNode) <= 0)
 	{
 		// Note, should NOT be less than 0
 		return false;
 	}
 	else
 	{
-		for (int i = (BaseNode.NbChildren() + 1); i <= BaseInput.NbChildren(); i++)
+		// Only start the Transaction once there's something to append, see SelectEdge
+		Transaction transaction(*this);
+		BaseNode = this->Relocate(BaseNode);
+		for (int i = (CountChildren(BaseNode) + 1); i <= CountChildren(BaseInput); i++)
 		{
 			TDF_Label NewNode = BaseInput.FindChild(i, false);
 			this->AppendNode(BaseNode, NewNode);
-			int BaseDepth = NewNode.Depth();
-			TDF_ChildIterator childIter(NewNode, true);
-			for (; childIter.More(); childIter.Next())
-			{
-				TDF_Label curNode = childIter.Value();
-			}
 		}
+		transaction.Commit();
 	}
 	return true;
 }
@@ -478,7 +550,7 @@ bool TopoNamingHelper::AppendTopoHistorySimple(const std::string& TargetRoot, co
 	TDF_Label BaseInput = SourceData.LabelFromTag(SourceData.GetTipNode());
 	//std::clog << "----------Dumping SourceData in AppendTopoHistory" << std::endl;
 	//std::clog << SourceData.DeepDump() << std::endl;
-	if (BaseInput.NbChildren() - TargetNode.NbChildren() <= 0)
+	if (CountChildren(BaseInput) - CountChildren(TargetNode) <= 0)
 	{
 		// Note, should NOT be less than 0
 		return false;
@@ -486,14 +558,15 @@ bool TopoNamingHelper::AppendTopoHistorySimple(const std::string& TargetRoot, co
 	else
 	{
 		// Loop over every node in the SourceData that is not in the TargetRoot
-		for (int i = (TargetNode.NbChildren() + 1); i <= BaseInput.NbChildren(); i++)
+		Transaction transaction(*this);
+		TargetNode = this->Relocate(TargetNode);
+		for (int i = (CountChildren(TargetNode) + 1); i <= CountChildren(BaseInput); i++)
 		{
-			// This is the new node to add
+			// This is the new node to add, along with everything under it
 			TDF_Label SourceNode = BaseInput.FindChild(i, false);
-			// This method should recursiviely append all children from SourceNode into
-			// TargetNode...
 			this->AppendNode(TargetNode, SourceNode);
 		}
+		transaction.Commit();
 	}
 	//std::clog << "----------Dumping TargetData in AppendTopoHistory at end" << std::endl;
 	//std::clog << this->DeepDump() << std::endl;
@@ -503,53 +576,261 @@ bool TopoNamingHelper::AppendTopoHistorySimple(const std::string& TargetRoot, co
 
 TopoDS_Edge TopoNamingHelper::GetSelectedEdge(const std::string NodeTag) const
 {
-	std::clog << "----------Retrieving edge for tag: " << NodeTag << std::endl;
-	TDF_Label EdgeNode = this->LabelFromTag(NodeTag);
+	TN_LOG_DEBUG(TopoNamingLog::Solve, "----------Retrieving edge for tag: " << NodeTag);
+	return this->GetSelectedEdge(this->LabelFromTag(NodeTag));
+}
+
+TopoDS_Edge TopoNamingHelper::GetSelectedEdge(const TDF_Label& EdgeNode) const
+{
+	TDF_LabelMap MyMap;
+
+	if (!EdgeNode.IsNull())
+	{
+		ScratchTransaction scratch(*this);
+		return TopoDS::Edge(this->SolveSelection(EdgeNode, MyMap, TopoDS_Shape()));
+	}
+	else
+	{
+		throw std::runtime_error("That Node does not appear to exist on the Data Framework");
+	}
+}
+
+TopoDS_Edge TopoNamingHelper::GetSelectedEdge(const TDF_Label& EdgeNode, const TopoDS_Shape& NewContext) const
+{
 	TDF_LabelMap MyMap;
 
 	if (!EdgeNode.IsNull())
 	{
-		//MyMap.Add(EdgeNode);
-		TNaming_Selector MySelector(EdgeNode);
-		bool solved = MySelector.Solve(MyMap);
-		if (solved)
+		ScratchTransaction scratch(*this);
+		return TopoDS::Edge(this->SolveSelection(EdgeNode, MyMap, NewContext));
+	}
+	else
+	{
+		throw std::runtime_error("That Node does not appear to exist on the Data Framework");
+	}
+}
+
+std::vector<TopoDS_Shape> TopoNamingHelper::SolveSelections(const std::vector<TDF_Label>& SelectionLabels) const
+{
+	// Every label in the Data Framework is fair game when solving, so the scope is built
+	// once and shared by all of the selections.
+	TDF_LabelMap Valid;
+	Valid.Add(myHistory->State->RootNode);
+	for (TDF_ChildIterator TreeIterator(myHistory->State->RootNode, Standard_True); TreeIterator.More(); TreeIterator.Next())
+	{
+		Valid.Add(TreeIterator.Value());
+	}
+
+	// One scratch transaction for all of them, so a selection sees what solving the ones
+	// it depends on wrote
+	ScratchTransaction scratch(*this);
+	std::vector<TopoDS_Shape> outShapes(SelectionLabels.size());
+	for (auto&& i : this->OrderSelections(SelectionLabels))
+	{
+		const TDF_Label& SelectionLabel = SelectionLabels[i];
+		if (SelectionLabel.IsNull())
 		{
-			std::clog << "----------Selection solve \x1B[32mWAS\033[0m succesfull!" << std::endl;
+			throw std::runtime_error("That Node does not appear to exist on the Data Framework");
 		}
-		else
+		outShapes[i] = this->SolveSelection(SelectionLabel, Valid, TopoDS_Shape());
+	}
+	return outShapes;
+}
+
+unsigned long TopoNamingHelper::GetHistoryVersion() const
+{
+	return myHistory->State->HistoryVersion;
+}
+
+TopoDS_Shape TopoNamingHelper::SolveSelection(const TDF_Label& SelectionLabel, TDF_LabelMap& Valid, const TopoDS_Shape& Context) const
+{
+	// Nothing the selection could depend on has changed since it was last solved, the
+	// same way
+	const bool wholeTree = !Valid.IsEmpty();
+	auto cached = myHistory->State->SolvedSelections.find(SelectionLabel);
+	if (cached != myHistory->State->SolvedSelections.end() && cached->second.Version == myHistory->State->HistoryVersion &&
+		cached->second.WholeTree == wholeTree && cached->second.Context.IsSame(Context))
+	{
+		return cached->second.Shape;
+	}
+
+	TNaming_Selector MySelector(SelectionLabel);
+	bool solved = MySelector.Solve(Valid);
+	TopoDS_Shape solvedShape;
+	if (solved)
+	{
+		TN_LOG_DEBUG(TopoNamingLog::Solve, "----------Selection solve WAS succesfull!");
+		solvedShape = MySelector.NamedShape()->Get();
+	}
+	else
+	{
+		TN_LOG_WARNING(TopoNamingLog::Solve, "----------selection solve was NOT succesful......");
+		TopoDS_Shape searchIn = Context;
+		if (searchIn.IsNull() && this->HasNodes())
+		{
+			searchIn = this->GetTipShape();
+		}
+		TopoDS_Shape recovered = this->ResolveBySignature(SelectionLabel, searchIn);
+		if (!recovered.IsNull())
+		{
+			TN_LOG_INFO(TopoNamingLog::Solve, "----------Recovered the selection from its geometric signature");
+			solvedShape = recovered;
+		}
+		else if (!MySelector.NamedShape().IsNull())
 		{
-			std::clog << "----------selection solve was \x1B[31mNOT\033[0m succesful......" << std::endl;
+			solvedShape = MySelector.NamedShape()->Get();
 		}
-		//Handle(TNaming_NamedShape) EdgeNS = MySelector.NamedShape();
-		//EdgeNode.FindAttribute(TNaming_NamedShape::GetID(), EdgeNS);
-		//const TopoDS_Edge& SelectedEdge = TopoDS::Edge(MySelector.NamedShape()->Get());
-		TopoDS_Edge SelectedEdge = TopoDS::Edge(MySelector.NamedShape()->Get());
-		return SelectedEdge;
 	}
-	else
+	myHistory->State->SolvedSelections[SelectionLabel] = { myHistory->State->HistoryVersion, wholeTree, Context, solvedShape };
+	return solvedShape;
+}
+
+TopoDS_Shape TopoNamingHelper::ResolveBySignature(const TDF_Label& SelectionLabel, const TopoDS_Shape& Context) const
+{
+	EdgeSignature signature;
+	if (Context.IsNull() || !RetrieveEdgeSignature(SelectionLabel, signature))
 	{
-		throw std::runtime_error("That Node does not appear to exist on the Data Framework");
+		return TopoDS_Shape();
+	}
+
+	std::shared_ptr<const TopologyIndex> contextIndex = this->GetTopologyIndex(Context);
+	const int match = contextIndex->EdgeSignatures().FindBestMatch(signature);
+	if (match == 0)
+	{
+		return TopoDS_Shape();
+	}
+	return contextIndex->Edges()(match);
+}
+
+void TopoNamingHelper::StoreSelectionSignature(const TDF_Label& SelectionLabel, const TopoDS_Shape& aShape, const TopoDS_Shape& Context)
+{
+	if (aShape.ShapeType() != TopAbs_EDGE)
+	{
+		return;
+	}
+	std::shared_ptr<const TopologyIndex> contextIndex = this->GetTopologyIndex(Context);
+	const int n = contextIndex->Edges().FindIndex(aShape);
+	if (n > 0)
+	{
+		StoreEdgeSignature(SelectionLabel, contextIndex->EdgeSignatures().Signature(n));
+	}
+}
+
+std::vector<size_t> TopoNamingHelper::OrderSelections(const std::vector<TDF_Label>& SelectionLabels) const
+{
+	// A selection whose naming refers to a label inside another selection has to be
+	// solved after that one. Find those dependencies, then do a topological sort that
+	// otherwise keeps the input order. The same label passed twice is only solved once.
+	TDF_LabelIntegerMap indexOf;
+	std::vector<size_t> unique;
+	for (size_t i = 0; i < SelectionLabels.size(); i++)
+	{
+		if (!SelectionLabels[i].IsNull() && !indexOf.IsBound(SelectionLabels[i]))
+		{
+			indexOf.Bind(SelectionLabels[i], static_cast<int>(i));
+			unique.push_back(i);
+		}
+	}
+
+	std::vector<std::vector<size_t>> dependents(SelectionLabels.size());
+	std::vector<int> numDependencies(SelectionLabels.size(), 0);
+	for (auto&& i : unique)
+	{
+		TDF_AttributeMap references;
+		TDF_Tool::OutReferences(SelectionLabels[i], references);
+		std::vector<size_t> dependencies;
+		for (TDF_MapIteratorOfAttributeMap it(references); it.More(); it.Next())
+		{
+			for (TDF_Label curLabel = it.Key()->Label(); !curLabel.IsRoot(); curLabel = curLabel.Father())
+			{
+				if (indexOf.IsBound(curLabel))
+				{
+					size_t dependency = static_cast<size_t>(indexOf.Find(curLabel));
+					if (dependency != i && std::find(dependencies.begin(), dependencies.end(), dependency) == dependencies.end())
+					{
+						dependencies.push_back(dependency);
+					}
+					break;
+				}
+			}
+		}
+		for (auto&& dependency : dependencies)
+		{
+			dependents[dependency].push_back(i);
+			numDependencies[i]++;
+		}
+	}
+
+	std::vector<size_t> order;
+	order.reserve(unique.size());
+	std::vector<bool> done(SelectionLabels.size(), false);
+	while (order.size() < unique.size())
+	{
+		bool progress = false;
+		for (auto&& i : unique)
+		{
+			if (!done[i] && numDependencies[i] == 0)
+			{
+				done[i] = true;
+				progress = true;
+				order.push_back(i);
+				for (auto&& dependent : dependents[i])
+				{
+					numDependencies[dependent]--;
+				}
+			}
+		}
+		if (!progress)
+		{
+			// A cycle, which TNaming shouldn't produce. Solve what's left in input order.
+			for (auto&& i : unique)
+			{
+				if (!done[i])
+				{
+					done[i] = true;
+					order.push_back(i);
+				}
+			}
+		}
+	}
+
+	// Duplicates simply get solved again right after, which is cheap since nothing changed
+	for (size_t i = 0; i < SelectionLabels.size(); i++)
+	{
+		if (SelectionLabels[i].IsNull() || static_cast<size_t>(indexOf.Find(SelectionLabels[i])) != i)
+		{
+			order.push_back(i);
+		}
 	}
+	return order;
 }
 
 TopoDS_Shape TopoNamingHelper::GetSelectedBaseShape(const std::string NodeTag) const
 {
-	std::ostringstream baseNodeStream;
-	baseNodeStream << NodeTag << ":1";
-	std::string baseNodeTag = baseNodeStream.str();
-	std::clog << "----------Retrieving Base for tag: " << baseNodeTag << std::endl;
-	return this->GetNodeShape(baseNodeTag);
+	TN_LOG_DEBUG(TopoNamingLog::Solve, "----------Retrieving Base for tag: " << NodeTag << ":1");
+	return this->GetSelectedBaseShape(this->LabelFromTag(NodeTag));
+}
+
+TopoDS_Shape TopoNamingHelper::GetSelectedBaseShape(const TDF_Label& EdgeNode) const
+{
+	if (EdgeNode.IsNull())
+	{
+		throw std::runtime_error("That Node does not appear to exist on the Data Framework\n");
+	}
+	return this->GetNodeShape(EdgeNode.FindChild(1, Standard_False));
 }
 
 TopoDS_Shape TopoNamingHelper::GetNodeShape(const std::string NodeTag) const
 {
-	std::ostringstream out;
-	out << "----------GetNodeShape for NodeTag = " << NodeTag << std::endl;
-	std::clog << out.str();
-	TDF_Label TargetNode = this->LabelFromTag(NodeTag);
+	TN_LOG_DEBUG(TopoNamingLog::Solve, "----------GetNodeShape for NodeTag = " << NodeTag);
+	return this->GetNodeShape(this->LabelFromTag(NodeTag));
+}
+
+TopoDS_Shape TopoNamingHelper::GetNodeShape(const TDF_Label& TargetNode) const
+{
 	//TDF_LabelMap MyMap;
 
-	//TDF_ChildIterator TreeIterator(myRootNode, Standard_True);
+	//TDF_ChildIterator TreeIterator(myHistory->State->RootNode, Standard_True);
 	//for(;TreeIterator.More(); TreeIterator.Next()){
 		//TDF_Label curLabel = TreeIterator.Value();
 		//MyMap.Add(curLabel);
@@ -575,28 +856,27 @@ TopoDS_Shape TopoNamingHelper::GetNodeShape(const std::string NodeTag) const
 		}
 		else
 		{
-			std::clog << "----------Throwing an error! Node does not contain a NamedShape...\n";
+			TN_LOG_ERROR(TopoNamingLog::Solve, "----------Throwing an error! Node does not contain a NamedShape...");
 			throw std::runtime_error("That Node does not appear to contain a NamedShape\n");
 		}
 	}
 	else
 	{
-		std::clog << "----------Throwing an error! Node doesn't exist...\n";
+		TN_LOG_ERROR(TopoNamingLog::Solve, "----------Throwing an error! Node doesn't exist...");
 		throw std::runtime_error("That Node does not appear to exist on the Data Framework\n");
 	}
 }
 
 TopoDS_Shape TopoNamingHelper::GetTipShape() const
 {
-	const std::string& tipTag = this->GetTipNode();
-	TDF_Label tipLabel = this->LabelFromTag(tipTag);
+	TDF_Label tipLabel = this->GetNodeLabel(CountChildren(this->myHistory->State->RootNode));
 	TopoDS_Shape tipShape = this->GetChildShape(tipLabel, 0);
 	return tipShape;
 }
 
 std::string TopoNamingHelper::GetTipNode() const
 {
-	return this->GetNode(this->myRootNode.NbChildren());
+	return this->GetNode(CountChildren(this->myHistory->State->RootNode));
 }
 
 std::string TopoNamingHelper::GetNode(const int& n) const
@@ -606,10 +886,28 @@ std::string TopoNamingHelper::GetNode(const int& n) const
 
 std::string TopoNamingHelper::GetNode(const std::string& tag, const int& n) const
 {
-	TDF_Label parent = this->LabelFromTag(tag);
-	TDF_Label outLabel = parent.FindChild(n, Standard_False);
+	return GetTag(this->GetNodeLabel(this->LabelFromTag(tag), n));
+}
+
+TDF_Label TopoNamingHelper::GetNodeLabel(const int& n) const
+{
+	return this->GetNodeLabel(this->myHistory->State->RootNode, n);
+}
+
+TDF_Label TopoNamingHelper::GetNodeLabel(const TDF_Label& Parent, const int& n) const
+{
+	return Parent.FindChild(n, Standard_False);
+}
+
+TDF_Label TopoNamingHelper::GetLabel(const std::string& tag) const
+{
+	return this->LabelFromTag(tag);
+}
+
+std::string TopoNamingHelper::GetTag(const TDF_Label& Label)
+{
 	TCollection_AsciiString outtag;
-	TDF_Tool::Entry(outLabel, outtag);
+	TDF_Tool::Entry(Label, outtag);
 	return outtag.ToCString();
 }
 
@@ -626,7 +924,7 @@ TopoDS_Shape TopoNamingHelper::GetChildShape(const TDF_Label& ParentLabel, const
 		ParentLabel.FindAttribute(TNaming_NamedShape::GetID(), OutNS);
 	}
 	TopoDS_Shape OutShape = TNaming_Tool::GetShape(OutNS);
-	std::clog << "Outshape.IsNull() = " << OutShape.IsNull() << "\n";
+	TN_LOG_DEBUG(TopoNamingLog::Solve, "Outshape.IsNull() = " << OutShape.IsNull());
 	return OutShape;
 }
 
@@ -638,7 +936,7 @@ std::string TopoNamingHelper::GetLatestFilletBase() const
 bool TopoNamingHelper::HasNodes() const
 {
 	bool out = false;
-	int numb = this->myRootNode.NbChildren();
+	int numb = CountChildren(this->myHistory->State->RootNode);
 	if (numb > 1)
 	{
 		out = true;
@@ -656,12 +954,16 @@ bool TopoNamingHelper::HasNodes() const
 
 void TopoNamingHelper::AddNode(const std::string& Name)
 {
-	TDF_Label label = TDF_TagSource::NewChild(this->myRootNode);
+	Transaction transaction(*this);
+	TDF_Label label = this->NewChild(this->myHistory->State->RootNode);
 	this->AddTextToLabel(label, Name);
+	transaction.Commit();
 }
 
-void TopoNamingHelper::AddTextToLabel(const TDF_Label& Label, const std::string& name, const std::string& extra)
+void TopoNamingHelper::AddTextToLabel(const TDF_Label& aLabel, const std::string& name, const std::string& extra)
 {
+	this->EnsureUnshared();
+	const TDF_Label Label = this->Relocate(aLabel);
 	if (!Label.IsAttribute(TDataStd_AsciiString::GetID()))
 	{
 		// Join name and str
@@ -685,12 +987,17 @@ bool TopoNamingHelper::CompareTwoEdgeTopologies(const TopoDS_Edge& edge1, const
 	double c1Start, c1End, c2Start, c2End;
 	Handle(Geom_Curve) curve1 = BRep_Tool::Curve(edge1, c1Start, c1End);
 	Handle(Geom_Curve) curve2 = BRep_Tool::Curve(edge2, c2Start, c2End);
+	if (curve1.IsNull() || curve2.IsNull())
+	{
+		// Degenerated edges don't have a curve to compare
+		return false;
+	}
 
 	// First, check if one is closed and the other isn't
 	if ((curve1->IsClosed() && !curve2->IsClosed()) ||
 		(!curve1->IsClosed() && curve2->IsClosed()))
 	{
-		std::clog << "----------One edge is closed" << std::endl;
+		TN_LOG_DEBUG(TopoNamingLog::Tracking, "----------One edge is closed");
 		// if one is closed and the other isn't they can't be equal.
 		return false;
 	}
@@ -710,20 +1017,101 @@ bool TopoNamingHelper::CompareTwoEdgeTopologies(const TopoDS_Edge& edge1, const
 		return false;
 	}
 
-	// finally, compare points on the lines
-	GeomAPI_ProjectPointOnCurve projector;
-	float interval = (c1End - c1Start) / numCheckPoints;
+	// Lines, circles and ellipses can be compared exactly without any sampling
+	GeomAdaptor_Curve adaptor1(curve1, c1Start, c1End);
+	GeomAdaptor_Curve adaptor2(curve2, c2Start, c2End);
+	const GeomAbs_CurveType type1 = adaptor1.GetType();
+	if (type1 == adaptor2.GetType())
+	{
+		switch (type1)
+		{
+			case GeomAbs_Line:
+				// Two straight segments with the same end points
+				return true;
+			case GeomAbs_Circle:
+			{
+				const gp_Circ circ1 = adaptor1.Circle();
+				const gp_Circ circ2 = adaptor2.Circle();
+				if (!circ1.Location().IsEqual(circ2.Location(), Precision::Confusion()) ||
+					std::abs(circ1.Radius() - circ2.Radius()) > Precision::Confusion() ||
+					!circ1.Axis().IsParallel(circ2.Axis(), Precision::Angular()))
+				{
+					return false;
+				}
+				// Same circle and same end points, but it could still be the other arc
+				const double midParam = ElCLib::Parameter(circ2, curve1->Value(0.5 * (c1Start + c1End)));
+				return ElCLib::InPeriod(midParam, c2Start, c2Start + 2 * M_PI) <= c2End;
+			}
+			case GeomAbs_Ellipse:
+			{
+				const gp_Elips elips1 = adaptor1.Ellipse();
+				const gp_Elips elips2 = adaptor2.Ellipse();
+				if (!elips1.Location().IsEqual(elips2.Location(), Precision::Confusion()) ||
+					std::abs(elips1.MajorRadius() - elips2.MajorRadius()) > Precision::Confusion() ||
+					std::abs(elips1.MinorRadius() - elips2.MinorRadius()) > Precision::Confusion() ||
+					!elips1.Axis().IsParallel(elips2.Axis(), Precision::Angular()) ||
+					!elips1.XAxis().IsParallel(elips2.XAxis(), Precision::Angular()))
+				{
+					return false;
+				}
+				const double midParam = ElCLib::Parameter(elips2, curve1->Value(0.5 * (c1Start + c1End)));
+				return ElCLib::InPeriod(midParam, c2Start, c2Start + 2 * M_PI) <= c2End;
+			}
+			default:
+				break;
+		}
+	}
+
+	// finally, compare points on the curves. Sample curve1 in double precision (a float
+	// parameter loses too much on long curves), and see if each sample is also at the
+	// matching parameter of curve2. That's the case whenever the two curves share a
+	// parametrization, and is much cheaper than a projection.
+	if (numCheckPoints < 2)
+	{
+		return true;
+	}
+	const bool reversed = !c1StartPnt.IsEqual(c2StartPnt, Precision::Confusion());
+	const int numSamples = numCheckPoints - 1;
+	std::vector<double> x1(numSamples), y1(numSamples), z1(numSamples);
+	std::vector<double> x2(numSamples), y2(numSamples), z2(numSamples);
+	std::vector<double> distances(numSamples);
+	for (int i = 0; i < numSamples; i++)
+	{
+		const double t = static_cast<double>(i + 1) / numCheckPoints;
+		const gp_Pnt point1 = curve1->Value(c1Start + t * (c1End - c1Start));
+		const gp_Pnt point2 = curve2->Value(reversed ? c2End - t * (c2End - c2Start) : c2Start + t * (c2End - c2Start));
+		x1[i] = point1.X(); y1[i] = point1.Y(); z1[i] = point1.Z();
+		x2[i] = point2.X(); y2[i] = point2.Y(); z2[i] = point2.Z();
+	}
+	// Plain loop over flat arrays so the compiler can vectorize it
+	for (int i = 0; i < numSamples; i++)
+	{
+		const double dx = x1[i] - x2[i];
+		const double dy = y1[i] - y2[i];
+		const double dz = z1[i] - z2[i];
+		distances[i] = dx * dx + dy * dy + dz * dz;
+	}
 
-	// NOTE: it should be OK if interval is negative: that just means that c1End is
-	// smaller than c1Start, but since we're starting at c1Start, the negative interval
-	// takes us in the correct direction.
-	for (float point = (c1Start + interval); (point <= c1End && point >= c1Start) || (point >= c1End && point <= c1Start); point += interval)
+	// Anything that didn't line up gets projected. The projector is set up on curve2
+	// once and then re-used for every point.
+	const double tolerance = Precision::Confusion() * Precision::Confusion();
+	GeomAPI_ProjectPointOnCurve projector;
+	bool projectorReady = false;
+	for (int i = 0; i < numSamples; i++)
 	{
-		gp_Pnt point1 = curve1->Value(point);
-		projector.Init(point1, curve2);
-		if (projector.LowerDistance() > Precision::Confusion())
+		if (distances[i] <= tolerance)
+		{
+			continue;
+		}
+		if (!projectorReady)
 		{
-			std::clog << "----------Projection not close enough" << std::endl;
+			projector.Init(curve2, std::min(c2Start, c2End), std::max(c2Start, c2End));
+			projectorReady = true;
+		}
+		projector.Perform(gp_Pnt(x1[i], y1[i], z1[i]));
+		if (projector.NbPoints() == 0 || projector.LowerDistance() > Precision::Confusion())
+		{
+			TN_LOG_DEBUG(TopoNamingLog::Tracking, "----------Projection not close enough");
 			return false;
 		}
 	}
@@ -732,106 +1120,327 @@ bool TopoNamingHelper::CompareTwoEdgeTopologies(const TopoDS_Edge& edge1, const
 
 bool TopoNamingHelper::CompareTwoFaceTopologies(const TopoDS_Shape& face1, const TopoDS_Shape& face2)
 {
-	TopTools_IndexedMapOfShape Edges1;
-	TopTools_IndexedMapOfShape Edges2;
-	TopExp::MapShapes(face1, TopAbs_EDGE, Edges1);
-	TopExp::MapShapes(face2, TopAbs_EDGE, Edges2);
-	if (Edges1.Extent() != Edges2.Extent())
+	// The surface check is a handful of integer compares, so do it before the edges
+	if (!FingerprintsMatch(MakeSurfaceFingerprint(TopoDS::Face(face1)), MakeSurfaceFingerprint(TopoDS::Face(face2))))
 	{
-		// Different number of edges mean different Faces
 		return false;
 	}
-	for (int i = 1; i <= Edges1.Extent(); i++)
+	return CompareFaceEdges(face1, face2);
+}
+
+bool TopoNamingHelper::CompareFaces(const TopoDS_Face& face1, const TopoDS_Face& face2) const
+{
+	if (!FingerprintsMatch(this->GetSurfaceFingerprint(face1), this->GetSurfaceFingerprint(face2)))
 	{
-		TopoDS_Edge Edge1 = TopoDS::Edge(Edges1.FindKey(i));
-		bool match = false;
-		for (int j = 1; j <= Edges2.Extent(); j++)
+		return false;
+	}
+	return CompareFaceEdges(face1, face2);
+}
+
+SurfaceFingerprint TopoNamingHelper::GetSurfaceFingerprint(const TopoDS_Face& aFace) const
+{
+	const SurfaceFingerprint* found = myFaceFingerprints.Find(aFace);
+	if (found != nullptr)
+	{
+		return *found;
+	}
+	return myFaceFingerprints.Insert(aFace, MakeSurfaceFingerprint(aFace));
+}
+
+TopoData TopoNamingHelper::DiffShapes(const TopoDS_Shape& OldShape, const TopoDS_Shape& NewShape) const
+{
+	std::vector<TopoDS_Face> OldFaces, NewFaces;
+	std::shared_ptr<const TopologyIndex> oldIndex = this->GetTopologyIndex(OldShape);
+	std::shared_ptr<const TopologyIndex> newIndex = this->GetTopologyIndex(NewShape);
+	OldFaces.reserve(oldIndex->Faces().Extent());
+	NewFaces.reserve(newIndex->Faces().Extent());
+	for (int i = 1; i <= oldIndex->Faces().Extent(); i++)
+	{
+		OldFaces.push_back(TopoDS::Face(oldIndex->Faces()(i)));
+	}
+	for (int i = 1; i <= newIndex->Faces().Extent(); i++)
+	{
+		NewFaces.push_back(TopoDS::Face(newIndex->Faces()(i)));
+	}
+
+	TopoData TData = this->DiffShapes(OldFaces, NewFaces);
+	TData.OldShape = OldShape;
+	TData.NewShape = NewShape;
+	return TData;
+}
+
+TopoData TopoNamingHelper::DiffShapes(const std::vector<TopoDS_Face>& OldFaces, const std::vector<TopoDS_Face>& NewFaces) const
+{
+	const size_t numOld = OldFaces.size();
+	const size_t numNew = NewFaces.size();
+	// index into NewFaces that each old face ended up paired with, and whether it changed
+	std::vector<int> pairedWith(numOld, -1);
+	std::vector<bool> unchanged(numOld, false);
+	std::vector<bool> newTaken(numNew, false);
+
+	auto centerOf = [](const Bnd_Box& box)
+	{
+		if (box.IsVoid())
+		{
+			return gp_Pnt();
+		}
+		double xMin, yMin, zMin, xMax, yMax, zMax;
+		box.Get(xMin, yMin, zMin, xMax, yMax, zMax);
+		return gp_Pnt(0.5 * (xMin + xMax), 0.5 * (yMin + yMax), 0.5 * (zMin + zMax));
+	};
+	std::vector<gp_Pnt> oldCenters, newCenters;
+	std::vector<Bnd_Box> newBoxes(numNew);
+	oldCenters.reserve(numOld);
+	newCenters.reserve(numNew);
+	for (auto&& aFace : OldFaces)
+	{
+		Bnd_Box box;
+		BRepBndLib::Add(aFace, box);
+		oldCenters.push_back(centerOf(box));
+	}
+	for (size_t j = 0; j < numNew; j++)
+	{
+		BRepBndLib::Add(NewFaces[j], newBoxes[j]);
+		newCenters.push_back(centerOf(newBoxes[j]));
+	}
+
+	// First, faces that are still on the same surface. Look up each old face's
+	// candidates by fingerprint, closest first, and pair it with one whose edges are
+	// unchanged. Only once every face has had a chance at that, pair whatever is left on
+	// the same surface as modified, so that an old face doesn't steal a new face that
+	// another old face is identical to.
+	std::unordered_multimap<SurfaceFingerprint, size_t, SurfaceFingerprintHasher> newBySurface;
+	newBySurface.reserve(numNew);
+	for (size_t j = 0; j < numNew; j++)
+	{
+		newBySurface.emplace(this->GetSurfaceFingerprint(NewFaces[j]), j);
+	}
+	std::vector<std::vector<size_t>> sameSurface(numOld);
+	for (size_t i = 0; i < numOld; i++)
+	{
+		auto range = newBySurface.equal_range(this->GetSurfaceFingerprint(OldFaces[i]));
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			sameSurface[i].push_back(it->second);
+		}
+		const gp_Pnt& center = oldCenters[i];
+		std::sort(sameSurface[i].begin(), sameSurface[i].end(), [&](const size_t& j1, const size_t& j2)
+		{
+			return center.SquareDistance(newCenters[j1]) < center.SquareDistance(newCenters[j2]);
+		});
+	}
+	for (size_t i = 0; i < numOld; i++)
+	{
+		for (auto&& j : sameSurface[i])
 		{
-			TopoDS_Edge Edge2 = TopoDS::Edge(Edges2.FindKey(j));
-			if (BRepTools::Compare(Edge1, Edge2))
+			if (!newTaken[j] && (OldFaces[i].IsSame(NewFaces[j]) || CompareFaceEdges(OldFaces[i], NewFaces[j])))
 			{
-				//std::clog << "----------Found match!" << std::endl;
-				match = true;
+				pairedWith[i] = static_cast<int>(j);
+				unchanged[i] = true;
+				newTaken[j] = true;
 				break;
 			}
-			if (CompareTwoEdgeTopologies(Edge1, Edge2))
+		}
+	}
+	for (size_t i = 0; i < numOld; i++)
+	{
+		for (auto&& j : sameSurface[i])
+		{
+			if (pairedWith[i] < 0 && !newTaken[j])
 			{
-				//std::clog << "----------Found match (my way)!" << std::endl;
-				match = true;
-				break;
+				pairedWith[i] = static_cast<int>(j);
+				newTaken[j] = true;
 			}
 		}
-		if (!match)
+	}
+
+	// Next, pair up what's left by position. Put the leftover new faces in a ShapeBVH and
+	// ask it for the MaxCandidates nearest to each leftover old face. A face's centre is
+	// inside its box, so once the boxes are further away than the worst of those nothing
+	// closer can turn up. Then hand out the best pairs first.
+	const size_t MaxCandidates = 4;
+	std::vector<size_t> leftoverNew;
+	std::vector<Bnd_Box> leftoverBoxes;
+	for (size_t j = 0; j < numNew; j++)
+	{
+		if (!newTaken[j])
 		{
-			// if any single edge does not match, then the faces cannot be equal.
-			//std::clog << "----------No match found..." << std::endl;
-			return false;
+			leftoverNew.push_back(j);
+			leftoverBoxes.push_back(newBoxes[j]);
 		}
 	}
-	//std::clog << "----------All edges match!" << std::endl;
-
-	//if (face2.IsEqual(face1)){
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE equal" << std::endl;
-	//}
-	//else{
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE NOT equal" << std::endl;
-
-	//}
-	//if (face2.IsSame(face1)){
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE same" << std::endl;
-	//}
-	//else{
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE NOT same" << std::endl;
+	const ShapeBVH leftoverBVH(leftoverBoxes);
 
-	//}
-	//if (face2.IsPartner(face1)){
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE partners" << std::endl;
-	//}
-	//else{
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE NOT partners" << std::endl;
+	// (different kind of surface, distance, old index, new index). Sorting these puts
+	// pairs on the same kind of surface first, closest first.
+	std::vector<std::tuple<bool, double, size_t, size_t>> candidates;
+	for (size_t i = 0; i < numOld && !leftoverNew.empty(); i++)
+	{
+		if (pairedWith[i] >= 0)
+		{
+			continue;
+		}
+		const gp_Pnt& center = oldCenters[i];
+		std::vector<std::pair<double, size_t>> nearest;
+		leftoverBVH.VisitNearest(center, [&](const int& n, const double& boxDistance)
+		{
+			if (nearest.size() == MaxCandidates && boxDistance > nearest.back().first)
+			{
+				return false;
+			}
+			const size_t j = leftoverNew[n - 1];
+			nearest.emplace_back(center.Distance(newCenters[j]), j);
+			std::sort(nearest.begin(), nearest.end());
+			if (nearest.size() > MaxCandidates)
+			{
+				nearest.pop_back();
+			}
+			return true;
+		});
 
-	//}
-	//if (face2.Location() == face1.Location()){
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE equal location" << std::endl;
-	//}
-	//else{
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE NOT equal location" << std::endl;
+		const SurfaceFingerprint oldFingerprint = this->GetSurfaceFingerprint(OldFaces[i]);
+		for (auto&& candidate : nearest)
+		{
+			const bool differentKind = !SameSurfaceKind(oldFingerprint, this->GetSurfaceFingerprint(NewFaces[candidate.second]));
+			candidates.emplace_back(differentKind, candidate.first, i, candidate.second);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+	for (auto&& candidate : candidates)
+	{
+		const size_t i = std::get<2>(candidate);
+		const size_t j = std::get<3>(candidate);
+		if (pairedWith[i] < 0 && !newTaken[j])
+		{
+			pairedWith[i] = static_cast<int>(j);
+			newTaken[j] = true;
+			// A fingerprint right on a rounding boundary could have kept an identical
+			// face out of the first pass
+			unchanged[i] = FingerprintsMatch(this->GetSurfaceFingerprint(OldFaces[i]), this->GetSurfaceFingerprint(NewFaces[j])) &&
+				CompareFaceEdges(OldFaces[i], NewFaces[j]);
+		}
+	}
 
-	//}
-	//if (face2.Orientation() == face1.Orientation()){
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE equal orientation" << std::endl;
-	//}
-	//else{
-		//std::clog << "----------for i = " << i << " and j = "<<j << ", Faces ARE NOT equal orientation" << std::endl;
+	TopoData TData;
+	for (size_t i = 0; i < numOld; i++)
+	{
+		if (pairedWith[i] < 0)
+		{
+			TData.DeletedFaces.push_back(OldFaces[i]);
+		}
+		else if (!unchanged[i])
+		{
+			TData.ModifiedFaces.push_back({ OldFaces[i], NewFaces[pairedWith[i]] });
+		}
+	}
+	for (size_t j = 0; j < numNew; j++)
+	{
+		if (!newTaken[j])
+		{
+			TData.GeneratedFaces.push_back(NewFaces[j]);
+		}
+	}
+	return TData;
+}
 
-	//}
+bool TopoNamingHelper::CompareFaceEdges(const TopoDS_Shape& face1, const TopoDS_Shape& face2)
+{
+	TopTools_IndexedMapOfShape Edges1;
+	TopTools_IndexedMapOfShape Edges2;
+	TopExp::MapShapes(face1, TopAbs_EDGE, Edges1);
+	TopExp::MapShapes(face2, TopAbs_EDGE, Edges2);
+	if (Edges1.Extent() != Edges2.Extent())
+	{
+		// Different number of edges mean different Faces
+		return false;
+	}
+	// Bucket face2's edges by EdgeKey, so each of face1's edges only has to be checked
+	// against the handful with the same key instead of all of them.
+	std::unordered_multimap<EdgeKey, int, EdgeKeyHasher> Edges2ByKey;
+	Edges2ByKey.reserve(Edges2.Extent());
+	for (int j = 1; j <= Edges2.Extent(); j++)
+	{
+		Edges2ByKey.emplace(MakeEdgeKey(TopoDS::Edge(Edges2.FindKey(j))), j);
+	}
 
-	Handle(Geom_Surface) Surface1 = BRep_Tool::Surface(TopoDS::Face(face1));
-	Handle(Geom_Surface) Surface2 = BRep_Tool::Surface(TopoDS::Face(face2));
-	if (Surface1->IsKind(STANDARD_TYPE(Geom_Plane)))
-	{
-		Handle(Geom_Plane) Plane1 = Handle(Geom_Plane)::DownCast(Surface1);
-		Handle(Geom_Plane) Plane2 = Handle(Geom_Plane)::DownCast(Surface2);
-		//gp_Dir p1Dir = Plane1->Axis().Direction();
-		//gp_Dir p2Dir = Plane2->Axis().Direction();
-		Standard_Real p1A, p1B, p1C, p1D, p2A, p2B, p2C, p2D;
-		Plane1->Coefficients(p1A, p1B, p1C, p1D);
-		Plane2->Coefficients(p2A, p2B, p2C, p2D);
-		//std::clog << "----------Plane1: " << p1A << "x + " <<p1B << "y + "<<p1C << "z + " << p1D << " = 0.0" << std::endl;
-		//std::clog << "----------Plane2: " << p2A << "x + " <<p2B << "y + "<<p2C << "z + " << p2D << " = 0.0" << std::endl;
-		//std::clog << "----------Plane1 Dir: (" << p1Dir.X() << ", " << p1Dir.Y() << ", " << p1Dir.Z() << ")" << std::endl;
-		//std::clog << "----------Plane2 Dir: (" << p2Dir.X() << ", " << p2Dir.Y() << ", " << p2Dir.Z() << ")" << std::endl;
-		if (p1A == p2A && p1B == p2B && p1C == p2C && p1D == p2D)
+	auto EdgesMatch = [](const TopoDS_Edge& Edge1, const TopoDS_Edge& Edge2)
+	{
+		return BRepTools::Compare(Edge1, Edge2) || CompareTwoEdgeTopologies(Edge1, Edge2);
+	};
+	// The same end points that CompareTwoEdgeTopologies looks at, or the vertexes of a
+	// degenerated edge
+	auto EndPoints = [](const TopoDS_Edge& anEdge, gp_Pnt& Start, gp_Pnt& End)
+	{
+		double first, last;
+		Handle(Geom_Curve) curve = BRep_Tool::Curve(anEdge, first, last);
+		if (!curve.IsNull())
 		{
-			return true;
+			Start = curve->Value(first);
+			End = curve->Value(last);
+			return;
 		}
-	}
-	else
+		TopoDS_Vertex vertex1, vertex2;
+		TopExp::Vertices(anEdge, vertex1, vertex2);
+		Start = vertex1.IsNull() ? gp_Pnt() : BRep_Tool::Pnt(vertex1);
+		End = vertex2.IsNull() ? Start : BRep_Tool::Pnt(vertex2);
+	};
+
+	// For when the keys don't match up: every end point of face2's edges, sorted on X.
+	// Only built if it's needed.
+	std::vector<std::pair<gp_Pnt, int>> Ends2;
+	auto ByX = [](const std::pair<gp_Pnt, int>& end1, const std::pair<gp_Pnt, int>& end2)
+	{
+		return end1.first.X() < end2.first.X();
+	};
+
+	for (int i = 1; i <= Edges1.Extent(); i++)
 	{
-		std::clog << "----------Don't know how to handle that geometry..." << std::endl;
+		TopoDS_Edge Edge1 = TopoDS::Edge(Edges1.FindKey(i));
+		bool match = false;
+		auto candidates = Edges2ByKey.equal_range(MakeEdgeKey(Edge1));
+		for (auto it = candidates.first; it != candidates.second && !match; ++it)
+		{
+			match = EdgesMatch(Edge1, TopoDS::Edge(Edges2.FindKey(it->second)));
+		}
+		if (!match)
+		{
+			// An end point could have landed just the other side of a grid line, or the
+			// same curve could be stored as a different type. That can happen for every
+			// edge of the face, so rather than trying all of face2's edges, only try the
+			// ones with an end point on Edge1's start point, whatever their curve type.
+			if (Ends2.empty())
+			{
+				Ends2.reserve(2 * Edges2.Extent());
+				for (int j = 1; j <= Edges2.Extent(); j++)
+				{
+					gp_Pnt start, end;
+					EndPoints(TopoDS::Edge(Edges2.FindKey(j)), start, end);
+					Ends2.emplace_back(start, j);
+					Ends2.emplace_back(end, j);
+				}
+				std::sort(Ends2.begin(), Ends2.end(), ByX);
+			}
+			gp_Pnt start, end;
+			EndPoints(Edge1, start, end);
+			const double tolerance = Precision::Confusion();
+			auto it = std::lower_bound(Ends2.begin(), Ends2.end(), std::make_pair(gp_Pnt(start.X() - tolerance, 0., 0.), 0), ByX);
+			for (; it != Ends2.end() && it->first.X() <= start.X() + tolerance && !match; ++it)
+			{
+				if (it->first.IsEqual(start, tolerance))
+				{
+					match = EdgesMatch(Edge1, TopoDS::Edge(Edges2.FindKey(it->second)));
+				}
+			}
+		}
+		if (!match)
+		{
+			// if any single edge does not match, then the faces cannot be equal.
+			//std::clog << "----------No match found..." << std::endl;
+			return false;
+		}
 	}
-	// else if (IsKind(cylindrical something)
-	return false;
+	//std::clog << "----------All edges match!" << std::endl;
+	return true;
 }
 
 void TopoNamingHelper::WriteShape(const TopoDS_Shape& aShape, const std::string& NameBase, const int& numb)
@@ -843,32 +1452,108 @@ void TopoNamingHelper::WriteShape(const TopoDS_Shape& aShape, const std::string&
 		outname << "_" << numb;
 	}
 	outname << ".brep";
-	std::clog << "----------writing " << outname.str() << std::endl;
+	TN_LOG_INFO(TopoNamingLog::IO, "----------writing " << outname.str());
 	BRepTools::Write(aShape, outname.str().c_str());
 }
 
 
+std::shared_ptr<const TopologyIndex> TopoNamingHelper::GetTopologyIndex(const TopoDS_Shape& aShape) const
+{
+	const std::shared_ptr<const TopologyIndex>* found = myTopologyIndexes.Find(aShape);
+	if (found != nullptr)
+	{
+		return *found;
+	}
+
+	// The cache drops the least recently used index once it's full, so it doesn't grow
+	// forever during a long session. Anybody still using an index it drops holds their
+	// own reference to it.
+	return myTopologyIndexes.Insert(aShape, std::make_shared<const TopologyIndex>(aShape));
+}
+
+void TopoNamingHelper::CarryOverTopologyIndex(const TopoDS_Shape& OldShape, const TopoDS_Shape& NewShape) const
+{
+	const std::shared_ptr<const TopologyIndex>* found = myTopologyIndexes.Find(OldShape);
+	if (found == nullptr || NewShape.IsNull())
+	{
+		return;
+	}
+	// A copy, since making NewShape's index could push OldShape's out of the cache
+	std::shared_ptr<const TopologyIndex> oldIndex = *found;
+	this->GetTopologyIndex(NewShape)->InheritBVHs(*oldIndex);
+}
+
+std::vector<TopoDS_Shape> TopoNamingHelper::FindSubShapesInBox(const TopoDS_Shape& Context, const TopAbs_ShapeEnum& aType,
+															   const Bnd_Box& aBox) const
+{
+	if (aType != TopAbs_FACE && aType != TopAbs_EDGE)
+	{
+		throw std::runtime_error("Can only search for Faces or Edges");
+	}
+	std::shared_ptr<const TopologyIndex> contextIndex = this->GetTopologyIndex(Context);
+	const ShapeBVH& bvh = aType == TopAbs_FACE ? contextIndex->FaceBVH() : contextIndex->EdgeBVH();
+
+	std::vector<TopoDS_Shape> found;
+	for (auto&& n : bvh.Intersecting(aBox))
+	{
+		found.push_back(contextIndex->Map(aType)(n));
+	}
+	return found;
+}
+
+TopoDS_Shape TopoNamingHelper::FindNearestSubShape(const TopoDS_Shape& Context, const TopAbs_ShapeEnum& aType, const gp_Pnt& aPoint) const
+{
+	if (aType != TopAbs_FACE && aType != TopAbs_EDGE)
+	{
+		throw std::runtime_error("Can only search for Faces or Edges");
+	}
+	std::shared_ptr<const TopologyIndex> contextIndex = this->GetTopologyIndex(Context);
+	const ShapeBVH& bvh = aType == TopAbs_FACE ? contextIndex->FaceBVH() : contextIndex->EdgeBVH();
+	const TopTools_IndexedMapOfShape& shapes = contextIndex->Map(aType);
+
+	// The boxes only give a lower bound, so keep going until they're further away than
+	// the closest actual distance found so far
+	TopoDS_Shape nearest;
+	double nearestDistance = RealLast();
+	TopoDS_Vertex target = BRepBuilderAPI_MakeVertex(aPoint);
+	bvh.VisitNearest(aPoint, [&](const int& n, const double& boxDistance)
+	{
+		if (boxDistance > nearestDistance)
+		{
+			return false;
+		}
+		BRepExtrema_DistShapeShape extrema(target, shapes(n));
+		if (extrema.IsDone() && extrema.Value() < nearestDistance)
+		{
+			nearestDistance = extrema.Value();
+			nearest = shapes(n);
+		}
+		return true;
+	});
+	return nearest;
+}
+
 void TopoNamingHelper::Dump() const
 {
-	TDF_Tool::DeepDump(std::clog, myDataFramework);
+	TDF_Tool::DeepDump(std::clog, myHistory->State->DataFramework);
 	std::clog << "\n";
 }
 
 void TopoNamingHelper::Dump(std::ostream& stream) const
 {
-	TDF_Tool::DeepDump(stream, myDataFramework);
+	TDF_Tool::DeepDump(stream, myHistory->State->DataFramework);
 	stream << "\n";
 }
 
-void TopoNamingHelper::DeepDump(std::stringstream& stream) const
+void TopoNamingHelper::DeepDump(std::ostream& stream) const
 {
 	//std::clog << "-----TopoNamingHelper::DeepDump(std::ostream...)\n";
 	TDF_IDFilter myFilter;
 	myFilter.Keep(TDataStd_AsciiString::GetID());
 	myFilter.Keep(TNaming_NamedShape::GetID());
-	//TDF_Tool::ExtendedDeepDump(stream, myDataFramework, myFilter);
+	//TDF_Tool::ExtendedDeepDump(stream, myHistory->State->DataFramework, myFilter);
 	//stream << "\n";
-	TDF_ChildIterator TreeIterator(myRootNode, Standard_True);
+	TDF_ChildIterator TreeIterator(myHistory->State->RootNode, Standard_True);
 	for (; TreeIterator.More(); TreeIterator.Next())
 	{
 		TDF_Label curLabel = TreeIterator.Value();
@@ -886,65 +1571,127 @@ void TopoNamingHelper::DeepDump(std::stringstream& stream) const
 	}
 }
 
-void TopoNamingHelper::DeepDump2(std::stringstream& stream) const
+void TopoNamingHelper::DeepDump2(std::ostream& stream) const
 {
-	//std::clog << "-----TopoNamingHelper::DeepDump(std::ostream...)\n";
-	TDF_IDFilter myFilter;
-	myFilter.Keep(TDataStd_AsciiString::GetID());
-	myFilter.Keep(TNaming_NamedShape::GetID());
-	//TDF_Tool::ExtendedDeepDump(stream, myDataFramework, myFilter);
-	//stream << "\n";
-	TDF_ChildIterator TreeIterator(myRootNode, Standard_True);
-	for (; TreeIterator.More(); TreeIterator.Next())
-	{
-		TDF_Label curLabel = TreeIterator.Value();
-		for (int i = 2; i <= curLabel.Depth(); i++)
-			stream << "--";
+	this->WriteDeepDump2([&stream](const char* data, size_t n) { stream.write(data, n); });
+}
 
-		// add the Tag info
-		curLabel.EntryDump(stream);
-		// Add data from AsciiString attribute
-		stream << " " << this->GetTextFromLabel(curLabel);
-		if (curLabel.IsAttribute(TNaming_NamedShape::GetID()))
+void TopoNamingHelper::DeepDump2(int fd) const
+{
+	this->WriteDeepDump2([fd](const char* data, size_t n)
+	{
+		while (n > 0)
 		{
-			stream << ", Evolution = ";
-			Handle(TNaming_NamedShape) curNS;
-			curLabel.FindAttribute(TNaming_NamedShape::GetID(), curNS);
-			switch (curNS->Evolution())
+			ssize_t written = ::write(fd, data, n);
+			if (written < 0)
 			{
-				case TNaming_PRIMITIVE:
-				{
-					stream << "PRIMITIVE";
-					break;
-				}
-				case TNaming_GENERATED:
-				{
-					stream << "GENERATED";
-					break;
-				}
-				case TNaming_MODIFY:
-				{
-					stream << "MODIFY";
-					break;
-				}
-				case TNaming_DELETE:
-				{
-					stream << "DELETE";
-					break;
-				}
-				case TNaming_SELECTED:
+				if (errno == EINTR)
 				{
-					stream << "SELECTED";
-					break;
-				}
-				default:
-				{
-					stream << "???";
-					break;
+					continue;
 				}
+				throw std::runtime_error("Could not write the dump out to the file descriptor");
 			}
+			data += written;
+			n -= static_cast<size_t>(written);
+		}
+	});
+}
+
+void TopoNamingHelper::WriteDeepDump2(const std::function<void(const char*, size_t)>& Sink) const
+{
+	// Everything goes through one buffer that's handed to Sink whenever it fills up, so
+	// a big history streams out as it's walked without allocating anything per label
+	const size_t flushAt = 1 << 16;
+	std::string buffer;
+	buffer.reserve(flushAt + 1024);
+	std::vector<int> tags;
+	char digits[16];
+
+	TDF_ChildIterator TreeIterator(myHistory->State->RootNode, Standard_True);
+	for (; TreeIterator.More(); TreeIterator.Next())
+	{
+		const TDF_Label& curLabel = TreeIterator.Value();
+		const int depth = curLabel.Depth();
+		for (int i = 2; i <= depth; i++)
+		{
+			buffer += "--";
+		}
+
+		// add the Tag info, same as TDF_Label::EntryDump
+		tags.clear();
+		for (TDF_Label aLabel = curLabel; !aLabel.IsNull(); aLabel = aLabel.Father())
+		{
+			tags.push_back(aLabel.Tag());
+		}
+		for (auto it = tags.rbegin(); it != tags.rend(); ++it)
+		{
+			if (it != tags.rbegin())
+			{
+				buffer += ':';
+			}
+			int length = std::snprintf(digits, sizeof(digits), "%d", *it);
+			buffer.append(digits, static_cast<size_t>(length));
+		}
+
+		// Add data from AsciiString attribute
+		buffer += ' ';
+		Handle(TDataStd_AsciiString) text;
+		if (curLabel.FindAttribute(TDataStd_AsciiString::GetID(), text))
+		{
+			buffer.append(text->Get().ToCString(), static_cast<size_t>(text->Get().Length()));
+		}
+		Handle(TNaming_NamedShape) curNS;
+		if (curLabel.FindAttribute(TNaming_NamedShape::GetID(), curNS))
+		{
+			buffer += ", Evolution = ";
+			buffer += EvolutionName(curNS->Evolution());
+		}
+		buffer += '\n';
+
+		if (buffer.size() >= flushAt)
+		{
+			Sink(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	}
+	if (!buffer.empty())
+	{
+		Sink(buffer.data(), buffer.size());
+	}
+}
+
+const char* TopoNamingHelper::EvolutionName(const TNaming_Evolution& Evolution)
+{
+	switch (Evolution)
+	{
+		case TNaming_PRIMITIVE:
+		{
+			return "PRIMITIVE";
+		}
+		case TNaming_GENERATED:
+		{
+			return "GENERATED";
+		}
+		case TNaming_MODIFY:
+		{
+			return "MODIFY";
+		}
+		case TNaming_DELETE:
+		{
+			return "DELETE";
+		}
+		case TNaming_REPLACE:
+		{
+			return "REPLACE";
+		}
+		case TNaming_SELECTED:
+		{
+			return "SELECTED";
+		}
+		default:
+		{
+			return "???";
 		}
-		stream << "\n";
 	}
 }
 
@@ -959,39 +1706,219 @@ std::string TopoNamingHelper::DeepDump() const
 
 std::string TopoNamingHelper::DeepDump2() const
 {
-	std::clog << "----------TopoNamingHelper::DeepDump2()" << std::endl;
-	std::stringstream output;
-	DeepDump2(output);
-	//std::clog << output.str();
-	return output.str();
+	TN_LOG_DEBUG(TopoNamingLog::IO, "----------TopoNamingHelper::DeepDump2()");
+	std::string output;
+	this->WriteDeepDump2([&output](const char* data, size_t n) { output.append(data, n); });
+	return output;
 }
 
 std::string TopoNamingHelper::GetTextFromLabel(const TDF_Label& Label) const
 {
-	std::ostringstream out;
-	if (Label.IsAttribute(TDataStd_AsciiString::GetID()))
-	{
-		Handle(TDataStd_AsciiString) data;
-		Label.FindAttribute(TDataStd_AsciiString::GetID(), data);
-		data->Get().Print(out);
-	}
-	else
+	Handle(TDataStd_AsciiString) data;
+	if (Label.FindAttribute(TDataStd_AsciiString::GetID(), data))
 	{
-		out << "";
+		return std::string(data->Get().ToCString(), static_cast<size_t>(data->Get().Length()));
 	}
-	return out.str();
+	return std::string();
 }
 
-std::string TopoNamingHelper::DFDump() const
+void TopoNamingHelper::ForEachHistoryRecord(const std::function<void(const HistoryRecord&)>& Visit) const
 {
-	std::ostringstream outStream;
-	TDF_IDFilter myFilter;
-	myFilter.Keep(TDataStd_AsciiString::GetID());
-	myFilter.Keep(TNaming_NamedShape::GetID());
-	myFilter.Keep(TNaming_UsedShapes::GetID());
-	TDF_Tool::ExtendedDeepDump(outStream, myDataFramework, myFilter);
-	return outStream.str();
-}
+	std::unordered_map<TopoDS_Shape, unsigned int, ShapeHasher, ShapeIsSame> shapeIds;
+	auto idOf = [&shapeIds](const TopoDS_Shape& aShape) -> unsigned int
+	{
+		if (aShape.IsNull())
+		{
+			return 0;
+		}
+		return shapeIds.emplace(aShape, static_cast<unsigned int>(shapeIds.size() + 1)).first->second;
+	};
+
+	// The one record is re-used for every label so its vectors keep their memory
+	HistoryRecord record;
+	std::vector<TDF_Label> labels(1, myHistory->State->RootNode);
+	for (TDF_ChildIterator it(myHistory->State->RootNode, Standard_True); it.More(); it.Next())
+	{
+		labels.push_back(it.Value());
+	}
+	for (auto&& curLabel : labels)
+	{
+		record.Path.clear();
+		for (TDF_Label aLabel = curLabel; !aLabel.IsNull(); aLabel = aLabel.Father())
+		{
+			record.Path.push_back(aLabel.Tag());
+		}
+		std::reverse(record.Path.begin(), record.Path.end());
+
+		record.Evolution = -1;
+		record.Shapes.clear();
+		Handle(TNaming_NamedShape) curNS;
+		if (curLabel.FindAttribute(TNaming_NamedShape::GetID(), curNS))
+		{
+			record.Evolution = static_cast<int>(curNS->Evolution());
+			for (TNaming_Iterator it(curNS); it.More(); it.Next())
+			{
+				record.Shapes.emplace_back(idOf(it.OldShape()), idOf(it.NewShape()));
+			}
+		}
+
+		record.Text.clear();
+		Handle(TDataStd_AsciiString) text;
+		if (curLabel.FindAttribute(TDataStd_AsciiString::GetID(), text))
+		{
+			record.Text.assign(text->Get().ToCString(), static_cast<size_t>(text->Get().Length()));
+		}
+		Visit(record);
+	}
+}
+
+void TopoNamingHelper::ExportBinary(std::ostream& stream) const
+{
+	std::string buffer;
+	auto putUInt = [&buffer](uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			buffer += static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	};
+	auto putInt = [&putUInt](int32_t value) { putUInt(static_cast<uint32_t>(value)); };
+
+	buffer = "TNHX";
+	putUInt(1);
+	stream.write(buffer.data(), buffer.size());
+
+	this->ForEachHistoryRecord([&](const HistoryRecord& record)
+	{
+		// Leave room for the byte count and fill it in once the record is done
+		buffer.assign(4, '\0');
+		putUInt(static_cast<uint32_t>(record.Path.size()));
+		for (auto&& tag : record.Path)
+		{
+			putInt(tag);
+		}
+		putInt(record.Evolution);
+		putUInt(static_cast<uint32_t>(record.Shapes.size()));
+		for (auto&& ids : record.Shapes)
+		{
+			putUInt(ids.first);
+			putUInt(ids.second);
+		}
+		putUInt(static_cast<uint32_t>(record.Text.size()));
+		buffer += record.Text;
+
+		const uint32_t length = static_cast<uint32_t>(buffer.size() - 4);
+		for (int i = 0; i < 4; i++)
+		{
+			buffer[i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+		}
+		stream.write(buffer.data(), buffer.size());
+	});
+}
+
+void TopoNamingHelper::ExportNDJSON(std::ostream& stream) const
+{
+	std::string line;
+	this->ForEachHistoryRecord([&](const HistoryRecord& record)
+	{
+		line = "{\"path\":\"";
+		for (size_t i = 0; i < record.Path.size(); i++)
+		{
+			if (i > 0)
+			{
+				line += ':';
+			}
+			line += std::to_string(record.Path[i]);
+		}
+		line += "\",\"evolution\":";
+		if (record.Evolution < 0)
+		{
+			line += "null";
+		}
+		else
+		{
+			line += '"';
+			line += EvolutionName(static_cast<TNaming_Evolution>(record.Evolution));
+			line += '"';
+		}
+		line += ",\"shapes\":[";
+		for (size_t i = 0; i < record.Shapes.size(); i++)
+		{
+			if (i > 0)
+			{
+				line += ',';
+			}
+			line += '[' + std::to_string(record.Shapes[i].first) + ',' + std::to_string(record.Shapes[i].second) + ']';
+		}
+		line += "],\"text\":\"";
+		for (auto&& c : record.Text)
+		{
+			switch (c)
+			{
+				case '"':
+					line += "\\\"";
+					break;
+				case '\\':
+					line += "\\\\";
+					break;
+				case '\n':
+					line += "\\n";
+					break;
+				case '\r':
+					line += "\\r";
+					break;
+				case '\t':
+					line += "\\t";
+					break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20)
+					{
+						char escaped[8];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+						line += escaped;
+					}
+					else
+					{
+						line += c;
+					}
+			}
+		}
+		line += "\"}\n";
+		stream.write(line.data(), line.size());
+	});
+}
+
+void TopoNamingHelper::Save(const std::string& FileName) const
+{
+	TN_LOG_INFO(TopoNamingLog::IO, "----------Saving history to " << FileName);
+	HistoryArchive::Write(myHistory->State->RootNode, FileName);
+}
+
+void TopoNamingHelper::Load(const std::string& FileName)
+{
+	TN_LOG_INFO(TopoNamingLog::IO, "----------Loading history from " << FileName);
+	// Read into a State of its own, so if the file is no good nothing has changed
+	std::shared_ptr<TopoNamingState> loaded = std::make_shared<TopoNamingState>();
+	HistoryArchive::Read(FileName, loaded->RootNode);
+	loaded->SelectionNode = loaded->RootNode.FindChild(1, Standard_True);
+	loaded->HistoryVersion = myHistory->State->HistoryVersion + 1;
+
+	myHistory->State = loaded;
+	myTopologyIndexes.Clear();
+	myFaceFingerprints.Clear();
+	this->RebuildIndex();
+}
+
+std::string TopoNamingHelper::DFDump() const
+{
+	std::ostringstream outStream;
+	TDF_IDFilter myFilter;
+	myFilter.Keep(TDataStd_AsciiString::GetID());
+	myFilter.Keep(TNaming_NamedShape::GetID());
+	myFilter.Keep(TNaming_UsedShapes::GetID());
+	TDF_Tool::ExtendedDeepDump(outStream, myHistory->State->DataFramework, myFilter);
+	return outStream.str();
+}
 
 void TopoNamingHelper::WriteShape(const TDF_Label aLabel, const std::string NameBase, const int numb) const
 {
@@ -1032,139 +1959,1244 @@ void TopoNamingHelper::WriteNode(const std::string NodeTag, const std::string Na
 
 TopoDS_Shape TopoNamingHelper::GetLatestShape(const std::string& tag)
 {
-	TDF_Label Node = this->LabelFromTag(tag);
+	return this->GetLatestShape(this->LabelFromTag(tag));
+}
+
+TopoDS_Shape TopoNamingHelper::GetLatestShape(const TDF_Label& Node)
+{
 	Handle(TNaming_NamedShape) ShapeNS;
 	Node.FindAttribute(TNaming_NamedShape::GetID(), ShapeNS);
-	std::clog << "----------ShapeNS.IsNull = " << (ShapeNS.IsNull() ? "Yes" : "No") << std::endl;
+	TN_LOG_DEBUG(TopoNamingLog::Solve, "----------ShapeNS.IsNull = " << (ShapeNS.IsNull() ? "Yes" : "No"));
 	return TNaming_Tool::CurrentShape(ShapeNS);
 }
 
 //-------------------- Private Methods --------------------
 TDF_Label TopoNamingHelper::LabelFromTag(const std::string& tag) const
 {
+	auto found = myHistory->State->TagToLabel.find(tag);
+	if (found != myHistory->State->TagToLabel.end())
+	{
+		return found->second;
+	}
+
+	// Not one of ours (or the cache was invalidated), so walk the tree and remember it
 	TDF_Label outLabel;
-	TDF_Tool::Label(myDataFramework, tag.c_str(), outLabel);
+	TDF_Tool::Label(myHistory->State->DataFramework, tag.c_str(), outLabel);
+	if (!outLabel.IsNull())
+	{
+		myHistory->State->TagToLabel.emplace(tag, outLabel);
+	}
 	return outLabel;
 }
 
-void TopoNamingHelper::AppendNode(const TDF_Label& Parent, const TDF_Label& Target)
+std::vector<ShapeReference> TopoNamingHelper::GetShapeHistory(const TopoDS_Shape& aShape) const
 {
-	TDF_Label NewNode = TDF_TagSource::NewChild(Parent);
-	TNaming_Builder Builder(NewNode);
-	if (Target.IsAttribute(TNaming_NamedShape::GetID()))
+	std::vector<ShapeReference> out;
+	auto found = myHistory->State->ShapeToLabels.find(aShape);
+	if (found == myHistory->State->ShapeToLabels.end())
 	{
-		Handle(TNaming_NamedShape) TargetNS;
-		Target.FindAttribute(TNaming_NamedShape::GetID(), TargetNS);
-		switch (TargetNS->Evolution())
+		return out;
+	}
+
+	// A label that has since lost its NamedShape (i.e. it was forgotten) doesn't count
+	for (auto&& aReference : found->second)
+	{
+		if (aReference.Label.IsAttribute(TNaming_NamedShape::GetID()))
+		{
+			out.push_back(aReference);
+		}
+	}
+	return out;
+}
+
+TDF_Label TopoNamingHelper::FindCreatingNode(const TopoDS_Shape& aShape) const
+{
+	std::vector<ShapeReference> references = this->GetShapeHistory(aShape);
+	for (auto it = references.rbegin(); it != references.rend(); ++it)
+	{
+		if (it->IsNewShape && it->Evolution != TNaming_SELECTED)
+		{
+			return it->Label;
+		}
+	}
+	return TDF_Label();
+}
+
+void TopoNamingHelper::IndexNamedShape(const TDF_Label& Label)
+{
+	this->BumpHistoryVersion();
+
+	Handle(TNaming_NamedShape) LabelNS;
+	if (!Label.FindAttribute(TNaming_NamedShape::GetID(), LabelNS))
+	{
+		return;
+	}
+
+	const TNaming_Evolution evolution = LabelNS->Evolution();
+	for (TNaming_Iterator it(LabelNS); it.More(); it.Next())
+	{
+		if (!it.OldShape().IsNull())
+		{
+			myHistory->State->ShapeToLabels[it.OldShape()].push_back({ Label, evolution, false });
+		}
+		if (!it.NewShape().IsNull())
+		{
+			myHistory->State->ShapeToLabels[it.NewShape()].push_back({ Label, evolution, true });
+		}
+	}
+}
+
+void TopoNamingHelper::BumpHistoryVersion()
+{
+	myHistory->State->HistoryVersion++;
+}
+
+void TopoNamingHelper::EnsureUnshared()
+{
+	if (myHistory->State.use_count() <= 1)
+	{
+		return;
+	}
+
+	// Some other fork is still using this State, so leave it be and carry on with a copy.
+	// NOTE: this copies every label, there's no way around that. A TDF_Label belongs to
+	// exactly one TDF_Data, and TNaming needs the whole history in one (the UsedShapes on
+	// the Root, the namings pointing all over the tree), so two Data Frameworks can't
+	// share the sub-trees that didn't change. BenchmarkFork in MinimumOccTest times it.
+	std::shared_ptr<const TopoNamingState> source = myHistory->State;
+	std::shared_ptr<TopoNamingState> copy = std::make_shared<TopoNamingState>();
+	Handle(TDF_RelocationTable) relocations = new TDF_RelocationTable();
+	const LabelOrder order = RecordedOrder(*source);
+	CopySubTree(source->RootNode, copy->RootNode, relocations, &order);
+	relocations->HasRelocation(source->SelectionNode, copy->SelectionNode);
+	copy->HistoryVersion = source->HistoryVersion;
+	myHistory->State = copy;
+
+	// TagToLabel and SolvedSelections are caches and fill back up on their own, but
+	// ShapeToLabels has to be complete. The shapes are the very same ones, so rather than
+	// walk the new tree, point the existing index at the copied labels.
+	this->RelocateIndex(source->ShapeToLabels, relocations, {});
+}
+
+TDF_Label TopoNamingHelper::Relocate(const TDF_Label& aLabel) const
+{
+	if (aLabel.IsNull() || aLabel.Data() == myHistory->State->DataFramework)
+	{
+		return aLabel;
+	}
+	TDF_Label relocated;
+	TDF_Tool::Label(myHistory->State->DataFramework, GetTag(aLabel).c_str(), relocated, Standard_True);
+	return relocated;
+}
+
+void TopoNamingHelper::CopySubTree(const TDF_Label& Source, const TDF_Label& Target, const Handle(TDF_RelocationTable)& Relocations,
+								   const LabelOrder* Order)
+{
+	// First the labels themselves and the plain attributes (TagSource, text, signatures).
+	// The shape-related ones are left for after, since they refer to one another.
+	std::vector<TDF_Label> sourceLabels(1, Source);
+	for (TDF_ChildIterator it(Source, Standard_True); it.More(); it.Next())
+	{
+		sourceLabels.push_back(it.Value());
+	}
+	std::vector<TDF_Label> namedShapeLabels, selectionLabels, namingLabels;
+	for (auto&& sourceLabel : sourceLabels)
+	{
+		TDF_Label targetLabel = Target;
+		if (!sourceLabel.IsEqual(Source))
+		{
+			// Pre-order, so the father has always been done already
+			TDF_Label targetFather;
+			Relocations->HasRelocation(sourceLabel.Father(), targetFather);
+			targetLabel = targetFather.FindChild(sourceLabel.Tag(), Standard_True);
+		}
+		Relocations->SetRelocation(sourceLabel, targetLabel);
+
+		for (TDF_AttributeIterator attributes(sourceLabel); attributes.More(); attributes.Next())
 		{
-			case TNaming_PRIMITIVE:
+			const Handle(TDF_Attribute)& attribute = attributes.Value();
+			if (attribute->IsKind(STANDARD_TYPE(TNaming_NamedShape)))
 			{
-				TopoDS_Shape NewShape = TNaming_Tool::GetShape(TargetNS);
-				Builder.Generated(NewShape);
-				break;
+				// A selection's NamedShapes refer to the history, so do those last
+				bool inSelection = false;
+				for (TDF_Label aLabel = sourceLabel; !aLabel.IsNull() && !aLabel.IsRoot(); aLabel = aLabel.Father())
+				{
+					if (aLabel.IsAttribute(TNaming_Naming::GetID()))
+					{
+						inSelection = true;
+						break;
+					}
+				}
+				(inSelection ? selectionLabels : namedShapeLabels).push_back(sourceLabel);
 			}
-			case TNaming_GENERATED:
+			else if (attribute->IsKind(STANDARD_TYPE(TNaming_Naming)))
 			{
-				TopoDS_Shape OldShape = TNaming_Tool::OriginalShape(TargetNS);
-				TopoDS_Shape NewShape = TNaming_Tool::GetShape(TargetNS);
-				Builder.Generated(OldShape, NewShape);
-				break;
+				namingLabels.push_back(sourceLabel);
 			}
-			case TNaming_MODIFY:
+			else if (!attribute->IsKind(STANDARD_TYPE(TNaming_UsedShapes)) && !targetLabel.IsAttribute(attribute->ID()))
 			{
-				TopoDS_Shape OldShape = TNaming_Tool::OriginalShape(TargetNS);
-				TopoDS_Shape NewShape = TNaming_Tool::GetShape(TargetNS);
-				Builder.Modify(OldShape, NewShape);
-				break;
+				// UsedShapes gets made by the TNaming_Builder's below
+				Handle(TDF_Attribute) copied = attribute->NewEmpty();
+				targetLabel.AddAttribute(copied);
+				attribute->Paste(copied, Relocations);
+				Relocations->SetRelocation(attribute, copied);
+			}
+		}
+	}
+
+	// Then re-build every NamedShape out of the very same shapes. Going through
+	// TNaming_Builder (rather than Paste, which copies the shapes) keeps the shapes
+	// identical and fills in the target's TNaming_UsedShapes. That lists the NamedShapes
+	// of each shape in the order they were built, so the order matters.
+	namedShapeLabels.insert(namedShapeLabels.end(), selectionLabels.begin(), selectionLabels.end());
+	if (Order)
+	{
+		auto placeOf = [Order](const TDF_Label& aLabel)
+		{
+			auto found = Order->find(aLabel);
+			return found == Order->end() ? Order->size() : found->second;
+		};
+		std::stable_sort(namedShapeLabels.begin(), namedShapeLabels.end(),
+						 [&placeOf](const TDF_Label& aLabel, const TDF_Label& anotherLabel)
+						 {
+							 return placeOf(aLabel) < placeOf(anotherLabel);
+						 });
+	}
+	for (auto&& sourceLabel : namedShapeLabels)
+	{
+		Handle(TNaming_NamedShape) sourceNS;
+		sourceLabel.FindAttribute(TNaming_NamedShape::GetID(), sourceNS);
+		TDF_Label targetLabel;
+		Relocations->HasRelocation(sourceLabel, targetLabel);
+
+		TNaming_Builder Builder(targetLabel);
+		for (TNaming_Iterator it(sourceNS); it.More(); it.Next())
+		{
+			Replay(Builder, sourceNS->Evolution(), it.OldShape(), it.NewShape());
+		}
+		Builder.NamedShape()->SetVersion(sourceNS->Version());
+		Relocations->SetRelocation(sourceNS, Builder.NamedShape());
+	}
+
+	// Finally the TNaming_Naming's, which point at the NamedShapes copied above
+	for (auto&& sourceLabel : namingLabels)
+	{
+		Handle(TNaming_Naming) sourceNaming;
+		sourceLabel.FindAttribute(TNaming_Naming::GetID(), sourceNaming);
+		TDF_Label targetLabel;
+		Relocations->HasRelocation(sourceLabel, targetLabel);
+		if (targetLabel.IsAttribute(TNaming_Naming::GetID()))
+		{
+			continue;
+		}
+		Handle(TNaming_Naming) copied = new TNaming_Naming();
+		targetLabel.AddAttribute(copied);
+		sourceNaming->Paste(copied, Relocations);
+		Relocations->SetRelocation(sourceNaming, copied);
+	}
+}
+
+void TopoNamingHelper::IndexSubTree(const TDF_Label& Parent)
+{
+	// NOTE: this goes in tag order, which isn't necessarily the order things were
+	// recorded in, so GetShapeHistory's "oldest first" becomes "lowest tag first"
+	this->IndexNamedShape(Parent);
+	for (TDF_ChildIterator it(Parent, Standard_True); it.More(); it.Next())
+	{
+		this->IndexNamedShape(it.Value());
+	}
+}
+
+LabelOrder TopoNamingHelper::RecordedOrder(const TopoNamingState& State)
+{
+	// Every shape's references say which of its labels came first. A topological sort
+	// puts all of that together, and goes by tag whenever it has a choice.
+	std::vector<TDF_Label> labels(1, State.RootNode);
+	LabelOrder tagOrder;
+	tagOrder.emplace(State.RootNode, 0);
+	for (TDF_ChildIterator it(State.RootNode, Standard_True); it.More(); it.Next())
+	{
+		tagOrder.emplace(it.Value(), labels.size());
+		labels.push_back(it.Value());
+	}
+
+	std::vector<std::vector<size_t>> later(labels.size());
+	std::vector<size_t> earlierCount(labels.size(), 0);
+	for (auto&& entry : State.ShapeToLabels)
+	{
+		bool hasPrevious = false;
+		size_t previous = 0;
+		for (auto&& reference : entry.second)
+		{
+			auto found = tagOrder.find(reference.Label);
+			if (found == tagOrder.end())
+			{
+				continue;
 			}
-			case TNaming_DELETE:
+			if (hasPrevious && previous != found->second)
 			{
-				TopoDS_Shape OldShape = TNaming_Tool::OriginalShape(TargetNS);
-				Builder.Delete(OldShape);
-				break;
+				later[previous].push_back(found->second);
+				earlierCount[found->second]++;
 			}
-			default:
+			hasPrevious = true;
+			previous = found->second;
+		}
+	}
+
+	std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+	for (size_t i = 0; i < labels.size(); i++)
+	{
+		if (earlierCount[i] == 0)
+		{
+			ready.push(i);
+		}
+	}
+	LabelOrder order;
+	order.reserve(labels.size());
+	while (!ready.empty())
+	{
+		const size_t next = ready.top();
+		ready.pop();
+		order.emplace(labels[next], order.size());
+		for (auto&& after : later[next])
+		{
+			if (--earlierCount[after] == 0)
 			{
-				std::runtime_error("Do not recognize this TNaming Evolution...");
+				ready.push(after);
 			}
 		}
 	}
+	// Only an index that contradicts itself leaves anything behind, in tag order it goes
+	for (size_t i = 0; i < labels.size(); i++)
+	{
+		if (earlierCount[i] > 0)
+		{
+			order.emplace(labels[i], order.size());
+		}
+	}
+	return order;
 }
 
-void TopoNamingHelper::MakeGeneratedNode(const TDF_Label& Parent, const TopoDS_Face& aFace)
+void TopoNamingHelper::RelocateIndex(const ShapeIndex& Source, const Handle(TDF_RelocationTable)& Relocations,
+									 const std::unordered_map<TDF_Label, TDF_Label, LabelHasher, LabelIsEqual>& CollapsedInto)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
-	TNaming_Builder Builder(childLabel);
-	Builder.Generated(aFace);
+	ShapeIndex written;
+	written.swap(myHistory->State->ShapeToLabels);
+	myHistory->State->ShapeToLabels.reserve(Source.size());
+	for (auto&& entry : Source)
+	{
+		std::vector<ShapeReference> references;
+		references.reserve(entry.second.size());
+		auto fromCollapsed = written.find(entry.first);
+		for (auto&& reference : entry.second)
+		{
+			TDF_Label copiedLabel;
+			if (Relocations->HasRelocation(reference.Label, copiedLabel))
+			{
+				references.push_back({ copiedLabel, reference.Evolution, reference.IsNewShape });
+				continue;
+			}
+			auto collapsed = CollapsedInto.find(OperationOf(reference.Label));
+			if (collapsed == CollapsedInto.end() || fromCollapsed == written.end())
+			{
+				continue;
+			}
+			// The first reference from a collapsed node brings in what was written in its
+			// place, the rest have nothing left to bring
+			for (auto&& writtenReference : fromCollapsed->second)
+			{
+				if (!writtenReference.Label.IsNull() && OperationOf(writtenReference.Label).IsEqual(collapsed->second))
+				{
+					references.push_back(writtenReference);
+					writtenReference.Label.Nullify();
+				}
+			}
+		}
+		if (!references.empty())
+		{
+			myHistory->State->ShapeToLabels[entry.first] = std::move(references);
+		}
+	}
+
+	// Shapes that only the newly written nodes know about
+	for (auto&& entry : written)
+	{
+		for (auto&& writtenReference : entry.second)
+		{
+			if (!writtenReference.Label.IsNull())
+			{
+				myHistory->State->ShapeToLabels[entry.first].push_back(writtenReference);
+			}
+		}
+	}
 }
 
-void TopoNamingHelper::MakeGeneratedNodes(const TDF_Label& Parent, const std::vector<TopoDS_Face>& Faces)
+TDF_Label TopoNamingHelper::OperationOf(const TDF_Label& aLabel)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
-	this->AddTextToLabel(childLabel, "Generated Faces");
-	for (auto&& aFace : Faces)
+	TDF_Label operation = aLabel;
+	while (!operation.IsNull() && !operation.IsRoot() && !operation.Father().IsRoot())
+	{
+		operation = operation.Father();
+	}
+	return operation;
+}
+
+void TopoNamingHelper::Replay(TNaming_Builder& Builder, const TNaming_Evolution& Evolution,
+							  const TopoDS_Shape& OldShape, const TopoDS_Shape& NewShape)
+{
+	switch (Evolution)
+	{
+		case TNaming_PRIMITIVE:
+			Builder.Generated(NewShape);
+			break;
+		case TNaming_GENERATED:
+			Builder.Generated(OldShape, NewShape);
+			break;
+		case TNaming_MODIFY:
+		case TNaming_REPLACE:
+			Builder.Modify(OldShape, NewShape);
+			break;
+		case TNaming_DELETE:
+			Builder.Delete(OldShape);
+			break;
+		case TNaming_SELECTED:
+			Builder.Select(NewShape, OldShape);
+			break;
+	}
+}
+
+size_t TopoNamingHelper::Compact()
+{
+	std::shared_ptr<const TopoNamingState> source = myHistory->State;
+
+	// The first and last operation nodes, and any a selection refers to, have to stay as
+	// they are. Group the rest into runs of modifications.
+	TDF_LabelMap pinned = this->ReferencedOperations();
+	std::vector<TDF_Label> operations;
+	for (int tag = 1; tag <= CountChildren(source->RootNode); tag++)
+	{
+		TDF_Label operation = source->RootNode.FindChild(tag, Standard_False);
+		if (!operation.IsNull() && !operation.IsEqual(source->SelectionNode))
+		{
+			operations.push_back(operation);
+		}
+	}
+	if (operations.size() < 3)
+	{
+		return 0;
+	}
+	pinned.Add(operations.front());
+	pinned.Add(operations.back());
+
+	std::vector<std::vector<TDF_Label>> groups;
+	bool lastCollapsible = false;
+	for (auto&& operation : operations)
+	{
+		bool collapsible = !pinned.Contains(operation) && IsModification(operation);
+		if (collapsible && lastCollapsible)
+		{
+			groups.back().push_back(operation);
+		}
+		else
+		{
+			groups.push_back(std::vector<TDF_Label>(1, operation));
+		}
+		lastCollapsible = collapsible;
+	}
+	const size_t removed = operations.size() - groups.size();
+	if (removed == 0)
+	{
+		return 0;
+	}
+
+	// Re-write it all into a fresh State. Anything that only the collapsed nodes used goes
+	// away along with the old one (unless a fork is still using it). Forks and the old
+	// tags are the reason to not edit the existing tree in place.
+	TN_LOG_INFO(TopoNamingLog::Tracking, "----------Compacting " << operations.size() << " operation nodes into " << groups.size());
+	myHistory->State = std::make_shared<TopoNamingState>();
+	myHistory->State->HistoryVersion = source->HistoryVersion;
+	myTopologyIndexes.Clear();
+	myFaceFingerprints.Clear();
+
+	Handle(TDF_RelocationTable) relocations = new TDF_RelocationTable();
+	const LabelOrder order = RecordedOrder(*source);
+	std::unordered_map<TDF_Label, TDF_Label, LabelHasher, LabelIsEqual> collapsedInto;
+	myHistory->State->SelectionNode = this->NewChild(myHistory->State->RootNode);
+	for (auto&& group : groups)
+	{
+		TDF_Label NewNode = this->NewChild(myHistory->State->RootNode);
+		if (group.size() == 1)
+		{
+			CopySubTree(group.front(), NewNode, relocations, &order);
+		}
+		else
+		{
+			// NOTE: this indexes the new node as it goes, RelocateIndex puts it in place
+			this->WriteCompactedRun(group, NewNode);
+			for (auto&& operation : group)
+			{
+				collapsedInto.emplace(operation, NewNode);
+			}
+		}
+	}
+	// The selections last, since their namings point at the operation nodes
+	CopySubTree(source->SelectionNode, myHistory->State->SelectionNode, relocations, &order);
+	this->RelocateIndex(source->ShapeToLabels, relocations, collapsedInto);
+	return removed;
+}
+
+bool TopoNamingHelper::IsModification(const TDF_Label& OperationLabel)
+{
+	Handle(TNaming_NamedShape) OperationNS;
+	if (OperationLabel.FindAttribute(TNaming_NamedShape::GetID(), OperationNS) && OperationNS->Evolution() != TNaming_MODIFY)
+	{
+		return false;
+	}
+	if (OperationLabel.IsAttribute(TNaming_Naming::GetID()))
+	{
+		return false;
+	}
+	for (TDF_ChildIterator it(OperationLabel, Standard_True); it.More(); it.Next())
+	{
+		Handle(TNaming_NamedShape) SubNS;
+		if (it.Value().IsAttribute(TNaming_Naming::GetID()) ||
+			(it.Value().FindAttribute(TNaming_NamedShape::GetID(), SubNS) && SubNS->Evolution() == TNaming_SELECTED))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+TDF_LabelMap TopoNamingHelper::ReferencedOperations() const
+{
+	const TDF_Label& SelectionNode = myHistory->State->SelectionNode;
+	std::vector<TDF_Label> referenced;
+
+	// What the namings point at...
+	TDF_AttributeMap references;
+	TDF_Tool::OutReferences(SelectionNode, references);
+	for (TDF_MapIteratorOfAttributeMap it(references); it.More(); it.Next())
+	{
+		referenced.push_back(it.Key()->Label());
+	}
+
+	// ...and wherever the selected shapes and their contexts were made
+	std::vector<TDF_Label> selectionLabels(1, SelectionNode);
+	for (TDF_ChildIterator it(SelectionNode, Standard_True); it.More(); it.Next())
+	{
+		selectionLabels.push_back(it.Value());
+	}
+	for (auto&& selectionLabel : selectionLabels)
+	{
+		Handle(TNaming_NamedShape) SelectionNS;
+		if (!selectionLabel.FindAttribute(TNaming_NamedShape::GetID(), SelectionNS))
+		{
+			continue;
+		}
+		for (TNaming_Iterator it(SelectionNS); it.More(); it.Next())
+		{
+			for (auto&& aShape : { it.OldShape(), it.NewShape() })
+			{
+				auto found = myHistory->State->ShapeToLabels.find(aShape);
+				if (found == myHistory->State->ShapeToLabels.end())
+				{
+					continue;
+				}
+				for (auto&& reference : found->second)
+				{
+					if (reference.IsNewShape)
+					{
+						referenced.push_back(reference.Label);
+					}
+				}
+			}
+		}
+	}
+
+	TDF_LabelMap operations;
+	for (auto&& aLabel : referenced)
+	{
+		TDF_Label operation = OperationOf(aLabel);
+		if (!operation.IsNull() && !operation.IsRoot() && !operation.IsEqual(SelectionNode))
+		{
+			operations.Add(operation);
+		}
+	}
+	return operations;
+}
+
+void TopoNamingHelper::WriteCompactedRun(const std::vector<TDF_Label>& Run, const TDF_Label& CompactedLabel)
+{
+	// The shape on each operation node itself, and the sub-shapes in the nodes under it,
+	// are composed separately so the whole shape ends up on CompactedLabel again
+	HistoryComposer operationShapes, subShapes;
+	for (auto&& operation : Run)
+	{
+		std::vector<HistoryComposer::Step> operationSteps, subSteps;
+		std::vector<TDF_Label> labels(1, operation);
+		for (TDF_ChildIterator it(operation, Standard_True); it.More(); it.Next())
+		{
+			labels.push_back(it.Value());
+		}
+		for (auto&& aLabel : labels)
+		{
+			Handle(TNaming_NamedShape) LabelNS;
+			if (!aLabel.FindAttribute(TNaming_NamedShape::GetID(), LabelNS))
+			{
+				continue;
+			}
+			std::vector<HistoryComposer::Step>& steps = aLabel.IsEqual(operation) ? operationSteps : subSteps;
+			for (TNaming_Iterator it(LabelNS); it.More(); it.Next())
+			{
+				steps.push_back({ it.OldShape(), it.NewShape(), LabelNS->Evolution() });
+			}
+		}
+		operationShapes.AddOperation(operationSteps);
+		subShapes.AddOperation(subSteps);
+	}
+
+	AddTextToLabel(CompactedLabel, "Compacted Node", std::to_string(Run.size()) + " operations");
+	std::vector<HistoryComposer::Step> steps = subShapes.Result();
+	std::vector<HistoryComposer::Step> operationSteps = operationShapes.Result();
+	bool allModified = !operationSteps.empty();
+	for (auto&& step : operationSteps)
+	{
+		allModified = allModified && step.Evolution == TNaming_MODIFY;
+	}
+	if (allModified)
+	{
+		TNaming_Builder OperationBuilder(CompactedLabel);
+		for (auto&& step : operationSteps)
+		{
+			OperationBuilder.Modify(step.OldShape, step.NewShape);
+		}
+		this->IndexNamedShape(CompactedLabel);
+	}
+	else
+	{
+		steps.insert(steps.end(), operationSteps.begin(), operationSteps.end());
+	}
+
+	// Same layout as TrackModifiedShape, one sub-node per shape
+	const std::pair<TNaming_Evolution, const char*> kinds[] = {
+		{ TNaming_GENERATED, "Generated faces" },
+		{ TNaming_MODIFY, "Modified faces" },
+		{ TNaming_DELETE, "Deleted faces" } };
+	for (auto&& kind : kinds)
+	{
+		std::vector<const HistoryComposer::Step*> ofKind;
+		for (auto&& step : steps)
+		{
+			TNaming_Evolution evolution = step.Evolution == TNaming_PRIMITIVE ? TNaming_GENERATED : step.Evolution;
+			if (evolution == kind.first)
+			{
+				ofKind.push_back(&step);
+			}
+		}
+		if (ofKind.empty())
+		{
+			continue;
+		}
+		TDF_Label KindLabel = this->NewChild(CompactedLabel);
+		AddTextToLabel(KindLabel, kind.second);
+		std::vector<TDF_Label> labels = this->NewChildren(KindLabel, ofKind.size());
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			TNaming_Builder Builder(labels[i]);
+			Replay(Builder, ofKind[i]->Evolution, ofKind[i]->OldShape, ofKind[i]->NewShape);
+			this->IndexNamedShape(labels[i]);
+		}
+	}
+}
+
+TDF_Label TopoNamingHelper::FindSelection(const TDF_Label& aNode, const TopoDS_Shape& aShape, const TopoDS_Shape& Context) const
+{
+	for (auto&& aReference : this->GetShapeHistory(aShape))
+	{
+		if (aReference.Evolution != TNaming_SELECTED || !aReference.IsNewShape || aReference.Label.Father() != aNode)
+		{
+			continue;
+		}
+		if (Context.IsNull())
+		{
+			return aReference.Label;
+		}
+		// TNaming_Selector::Select records the context as the 'old' shape
+		Handle(TNaming_NamedShape) SelectionNS;
+		aReference.Label.FindAttribute(TNaming_NamedShape::GetID(), SelectionNS);
+		for (TNaming_Iterator it(SelectionNS); it.More(); it.Next())
+		{
+			if (it.NewShape().IsEqual(aShape) && it.OldShape().IsSame(Context))
+			{
+				return aReference.Label;
+			}
+		}
+	}
+	return TDF_Label();
+}
+
+bool TopoNamingHelper::CheckIfSelectionExists(const TDF_Label aNode, const TopoDS_Face aFace) const
+{
+	return !this->FindSelection(aNode, aFace).IsNull();
+}
+
+void TopoNamingHelper::InvalidateTagCache()
+{
+	myHistory->State->TagToLabel.clear();
+}
+
+bool TopoNamingHelper::Undo()
+{
+	// NOTE: a State shared with a fork can't be rolled back without changing the fork too
+	if (myHistory->State->UndoDeltas.empty() || myHistory->State.use_count() > 1 || !this->UndoStepsValid())
+	{
+		return false;
+	}
+	std::shared_ptr<TopoNamingState> state = myHistory->State;
+	Handle(TDF_Delta) delta = state->UndoDeltas.back();
+	state->UndoDeltas.pop_back();
+	state->UndoAttributeDeltas -= delta->AttributeDeltas().Extent();
+	if (!delta->IsApplicable(state->DataFramework->Time()))
+	{
+		// Something changed the Data Framework outside of a Track* call
+		state->UndoDeltas.clear();
+		state->RedoDeltas.clear();
+		state->UndoAttributeDeltas = 0;
+		return false;
+	}
+	Handle(TDF_Delta) redo = state->DataFramework->Undo(delta, Standard_True);
+	if (!redo.IsNull())
+	{
+		state->RedoDeltas.push_back(redo);
+	}
+	this->ReindexDelta(delta);
+	this->RecordUndoTags();
+	return true;
+}
+
+bool TopoNamingHelper::Redo()
+{
+	if (myHistory->State->RedoDeltas.empty() || myHistory->State.use_count() > 1 || !this->UndoStepsValid())
+	{
+		return false;
+	}
+	std::shared_ptr<TopoNamingState> state = myHistory->State;
+	Handle(TDF_Delta) delta = state->RedoDeltas.back();
+	state->RedoDeltas.pop_back();
+	if (!delta->IsApplicable(state->DataFramework->Time()))
+	{
+		state->RedoDeltas.clear();
+		return false;
+	}
+	Handle(TDF_Delta) undo = state->DataFramework->Undo(delta, Standard_True);
+	if (!undo.IsNull())
+	{
+		this->PushUndoDelta(undo);
+	}
+	this->ReindexDelta(delta);
+	this->RecordUndoTags();
+	return true;
+}
+
+bool TopoNamingHelper::CanUndo() const
+{
+	return !myHistory->State->UndoDeltas.empty();
+}
+
+bool TopoNamingHelper::CanRedo() const
+{
+	return !myHistory->State->RedoDeltas.empty();
+}
+
+void TopoNamingHelper::SetUndoLimits(const size_t& MaxSteps, const size_t& MaxAttributeDeltas)
+{
+	myHistory->MaxUndoSteps = MaxSteps;
+	myHistory->MaxUndoAttributeDeltas = MaxAttributeDeltas;
+	// The steps of a State shared with a fork are the fork's too. This helper's copy of
+	// the State will start out without any anyway.
+	if (myHistory->State.use_count() <= 1)
+	{
+		this->PushUndoDelta(Handle(TDF_Delta)());
+	}
+}
+
+TopoNamingHelper::Transaction::Transaction(TopoNamingHelper& Helper) : myHelper(Helper)
+{
+	// Has to come first, so that the transaction is on the Data Framework that gets written
+	myHelper.EnsureUnshared();
+	const Handle(TDF_Data)& data = myHelper.myHistory->State->DataFramework;
+	if (data->Transaction() == 0)
+	{
+		// Drops the undo steps if anything got in between this and the last transaction
+		myHelper.UndoStepsValid();
+		data->OpenTransaction();
+		myOpened = true;
+	}
+}
+
+TopoNamingHelper::Transaction::~Transaction()
+{
+	if (!myOpened)
+	{
+		return;
+	}
+	// The same as AbortTransaction, but holding on to the delta, which says what has to
+	// come back out of the index. Nothing written, nothing to do.
+	const Handle(TDF_Data)& data = myHelper.myHistory->State->DataFramework;
+	Handle(TDF_Delta) delta = data->CommitTransaction(Standard_True);
+	if (!delta.IsNull() && !delta->IsEmpty())
+	{
+		data->Undo(delta, Standard_False);
+		myHelper.ReindexDelta(delta);
+	}
+}
+
+void TopoNamingHelper::Transaction::Commit()
+{
+	if (!myOpened)
+	{
+		return;
+	}
+	myOpened = false;
+	std::shared_ptr<TopoNamingState> state = myHelper.myHistory->State;
+	Handle(TDF_Delta) delta = state->DataFramework->CommitTransaction(Standard_True);
+	if (!delta.IsNull() && !delta->IsEmpty())
+	{
+		state->RedoDeltas.clear();
+		myHelper.PushUndoDelta(delta);
+	}
+	myHelper.RecordUndoTags();
+}
+
+TopoNamingHelper::ScratchTransaction::ScratchTransaction(const TopoNamingHelper& Helper)
+	: myData(Helper.myHistory->State->DataFramework)
+{
+	myData->OpenTransaction();
+}
+
+TopoNamingHelper::ScratchTransaction::~ScratchTransaction()
+{
+	myData->AbortTransaction();
+}
+
+void TopoNamingHelper::PushUndoDelta(const Handle(TDF_Delta)& Delta)
+{
+	TopoNamingState& state = *myHistory->State;
+	if (!Delta.IsNull())
+	{
+		state.UndoDeltas.push_back(Delta);
+		state.UndoAttributeDeltas += Delta->AttributeDeltas().Extent();
+	}
+	while (!state.UndoDeltas.empty() &&
+		   (state.UndoDeltas.size() > myHistory->MaxUndoSteps || state.UndoAttributeDeltas > myHistory->MaxUndoAttributeDeltas))
+	{
+		state.UndoAttributeDeltas -= state.UndoDeltas.front()->AttributeDeltas().Extent();
+		state.UndoDeltas.pop_front();
+	}
+}
+
+void TopoNamingHelper::RecordUndoTags()
+{
+	myHistory->State->RootTags = CountChildren(myHistory->State->RootNode);
+	myHistory->State->SelectionTags = CountChildren(myHistory->State->SelectionNode);
+}
+
+bool TopoNamingHelper::UndoStepsValid()
+{
+	TopoNamingState& state = *myHistory->State;
+	if (state.RootTags == CountChildren(state.RootNode) && state.SelectionTags == CountChildren(state.SelectionNode))
+	{
+		return true;
+	}
+	if (!state.UndoDeltas.empty() || !state.RedoDeltas.empty())
+	{
+		TN_LOG_WARNING(TopoNamingLog::Tracking, "----------Labels were added outside of a transaction, dropping the undo steps");
+	}
+	state.UndoDeltas.clear();
+	state.RedoDeltas.clear();
+	state.UndoAttributeDeltas = 0;
+	this->RecordUndoTags();
+	return false;
+}
+
+void TopoNamingHelper::ReindexDelta(const Handle(TDF_Delta)& Delta)
+{
+	this->BumpHistoryVersion();
+
+	// What the NamedShape of each label Delta touched holds now
+	struct CurrentReference
+	{
+		TopoDS_Shape Shape;
+		ShapeReference Reference;
+		bool Indexed;
+	};
+	std::unordered_map<TDF_Label, std::vector<CurrentReference>, LabelHasher, LabelIsEqual> current;
+	std::vector<TDF_Label> changedLabels;
+	for (TDF_ListIteratorOfAttributeDeltaList it(Delta->AttributeDeltas()); it.More(); it.Next())
+	{
+		const TDF_Label aLabel = it.Value()->Label();
+		if (it.Value()->ID() != TNaming_NamedShape::GetID() || current.find(aLabel) != current.end())
+		{
+			continue;
+		}
+		std::vector<CurrentReference>& references = current[aLabel];
+		changedLabels.push_back(aLabel);
+		Handle(TNaming_NamedShape) LabelNS;
+		if (!aLabel.FindAttribute(TNaming_NamedShape::GetID(), LabelNS))
+		{
+			continue;
+		}
+		for (TNaming_Iterator shapes(LabelNS); shapes.More(); shapes.Next())
+		{
+			if (!shapes.OldShape().IsNull())
+			{
+				references.push_back({ shapes.OldShape(), { aLabel, LabelNS->Evolution(), false }, false });
+			}
+			if (!shapes.NewShape().IsNull())
+			{
+				references.push_back({ shapes.NewShape(), { aLabel, LabelNS->Evolution(), true }, false });
+			}
+		}
+	}
+	if (changedLabels.empty())
+	{
+		return;
+	}
+
+	// Whatever those labels still hold stays where it was in the index, the rest goes
+	ShapeIndex& index = myHistory->State->ShapeToLabels;
+	for (auto entry = index.begin(); entry != index.end();)
+	{
+		std::vector<ShapeReference>& references = entry->second;
+		references.erase(std::remove_if(references.begin(), references.end(), [&](const ShapeReference& reference)
+		{
+			auto found = current.find(reference.Label);
+			if (found == current.end())
+			{
+				return false;
+			}
+			for (auto&& candidate : found->second)
+			{
+				if (!candidate.Indexed && candidate.Reference.IsNewShape == reference.IsNewShape &&
+					candidate.Reference.Evolution == reference.Evolution && candidate.Shape.IsEqual(entry->first))
+				{
+					candidate.Indexed = true;
+					return false;
+				}
+			}
+			return true;
+		}), references.end());
+		entry = references.empty() ? index.erase(entry) : std::next(entry);
+	}
+
+	// and whatever is new to them goes at the end, as the most recent. One step writes its
+	// labels in tag order, so that's the order they go in.
+	auto pathOf = [](const TDF_Label& aLabel)
+	{
+		std::vector<int> path;
+		for (TDF_Label parent = aLabel; !parent.IsNull(); parent = parent.Father())
+		{
+			path.push_back(parent.Tag());
+		}
+		std::reverse(path.begin(), path.end());
+		return path;
+	};
+	std::sort(changedLabels.begin(), changedLabels.end(), [&pathOf](const TDF_Label& aLabel, const TDF_Label& anotherLabel)
+	{
+		return pathOf(aLabel) < pathOf(anotherLabel);
+	});
+	for (auto&& aLabel : changedLabels)
+	{
+		for (auto&& candidate : current[aLabel])
+		{
+			if (!candidate.Indexed)
+			{
+				index[candidate.Shape].push_back(candidate.Reference);
+			}
+		}
+	}
+}
+
+void TopoNamingHelper::RebuildIndex()
+{
+	// NOTE: TagToLabel can stay, the labels it points at are still there (just empty)
+	myHistory->State->ShapeToLabels.clear();
+	this->IndexSubTree(myHistory->State->RootNode);
+}
+
+int TopoNamingHelper::CountChildren(const TDF_Label& Parent)
+{
+	Handle(TDF_TagSource) tagSource;
+	if (Parent.FindAttribute(TDF_TagSource::GetID(), tagSource))
+	{
+		return tagSource->Get();
+	}
+	return Parent.NbChildren();
+}
+
+TDF_Label TopoNamingHelper::NewChild(const TDF_Label& Parent)
+{
+	this->EnsureUnshared();
+	TDF_Label child = TDF_TagSource::NewChild(this->Relocate(Parent));
+	myHistory->State->TagToLabel.emplace(GetTag(child), child);
+	this->BumpHistoryVersion();
+	return child;
+}
+
+TDF_Label TopoNamingHelper::MakeChild(const TDF_Label& ParentLabel, const int& Tag)
+{
+	this->EnsureUnshared();
+	const TDF_Label Parent = this->Relocate(ParentLabel);
+	Handle(TDF_TagSource) tagSource = TDF_TagSource::Set(Parent);
+	if (tagSource->Get() < Tag)
+	{
+		tagSource->Set(Tag);
+	}
+	TDF_Label child = Parent.FindChild(Tag, Standard_True);
+	myHistory->State->TagToLabel.emplace(GetTag(child), child);
+	this->BumpHistoryVersion();
+	return child;
+}
+
+std::vector<TDF_Label> TopoNamingHelper::NewChildren(const TDF_Label& ParentLabel, const size_t& n)
+{
+	// Equivalent to calling TDF_TagSource::NewChild n times, but the TagSource is only
+	// read and written once.
+	std::vector<TDF_Label> children;
+	if (n == 0)
+	{
+		return children;
+	}
+	children.reserve(n);
+
+	this->EnsureUnshared();
+	const TDF_Label Parent = this->Relocate(ParentLabel);
+	Handle(TDF_TagSource) tagSource = TDF_TagSource::Set(Parent);
+	const int firstTag = tagSource->Get() + 1;
+	const int lastTag = firstTag + static_cast<int>(n) - 1;
+	const std::string parentTag = GetTag(Parent) + ":";
+	for (int tag = firstTag; tag <= lastTag; tag++)
+	{
+		children.push_back(Parent.FindChild(tag, Standard_True));
+		myHistory->State->TagToLabel.emplace(parentTag + std::to_string(tag), children.back());
+	}
+	tagSource->Set(lastTag);
+	this->BumpHistoryVersion();
+	return children;
+}
+
+TDF_Label TopoNamingHelper::CommitHistory(const TopoDS_Shape& BaseShape, const TopoDS_Shape& ResultShape,
+										  const OperationHistory& History, const int Kinds, const std::string& name)
+{
+	// Create a new node under the Root node for the result Shape and it's
+	// modified/deleted/generated sub-shapes. Each kind of history gets its own sub-node,
+	// whose tag is given by HistoryKindTag
+	TDF_Label OperationRootLabel = this->NewChild(myHistory->State->RootNode);
+	AddTextToLabel(OperationRootLabel, name);
+
+	// Start by adding the result shape. This will also create the TNaming_UsedShapes
+	// under the Root node if it doesn't exist. Sweeps (anything that can't modify) make
+	// a new shape out of BaseShape rather than changing it.
+	TNaming_Builder OperationBuilder(OperationRootLabel);
+	if (Kinds & HistoryModified)
+	{
+		OperationBuilder.Modify(BaseShape, ResultShape);
+	}
+	else
+	{
+		OperationBuilder.Generated(BaseShape, ResultShape);
+	}
+	this->CarryOverTopologyIndex(BaseShape, ResultShape);
+	this->IndexNamedShape(OperationRootLabel);
+
+	this->WriteHistory(OperationRootLabel, History, Kinds);
+	return OperationRootLabel;
+}
+
+void TopoNamingHelper::WriteHistory(const TDF_Label& OperationLabel, const OperationHistory& History, const int Kinds)
+{
+	// Write out everything we gathered, always in the same order: shapes generated
+	// from edges, modified faces, deleted faces and shapes generated from vertices and
+	// faces.
+	if (Kinds & HistoryFromEdges)
+	{
+		TDF_Label FacesFromEdgesLabel = this->MakeChild(OperationLabel, HistoryKindTag(HistoryFromEdges));
+		AddTextToLabel(FacesFromEdgesLabel, "Faces from edges");
+		std::vector<TDF_Label> labels = this->NewChildren(FacesFromEdgesLabel, History.GeneratedFromEdges.size());
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			AddTextToLabel(labels[i], "Face generated from Edge");
+			TNaming_Builder FacesFromEdgeBuilder(labels[i]);
+			FacesFromEdgeBuilder.Generated(History.GeneratedFromEdges[i].first, History.GeneratedFromEdges[i].second);
+			this->IndexNamedShape(labels[i]);
+		}
+	}
+
+	if (Kinds & HistoryModified)
+	{
+		TDF_Label ModifiedFacesLabel = this->MakeChild(OperationLabel, HistoryKindTag(HistoryModified));
+		AddTextToLabel(ModifiedFacesLabel, "Modified faces");
+		std::vector<TDF_Label> labels = this->NewChildren(ModifiedFacesLabel, History.ModifiedFaces.size());
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			AddTextToLabel(labels[i], "Modified face");
+			TNaming_Builder ModifiedBuilder(labels[i]);
+			ModifiedBuilder.Modify(History.ModifiedFaces[i].first, History.ModifiedFaces[i].second);
+			this->IndexNamedShape(labels[i]);
+		}
+	}
+
+	if (Kinds & HistoryDeleted)
+	{
+		TDF_Label DeletedFacesLabel = this->MakeChild(OperationLabel, HistoryKindTag(HistoryDeleted));
+		AddTextToLabel(DeletedFacesLabel, "Deleted faces");
+		std::vector<TDF_Label> labels = this->NewChildren(DeletedFacesLabel, History.DeletedFaces.size());
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			AddTextToLabel(labels[i], "Deleted face");
+			TNaming_Builder DeletedBuilder(labels[i]);
+			DeletedBuilder.Delete(History.DeletedFaces[i]);
+			this->IndexNamedShape(labels[i]);
+		}
+	}
+
+	if (Kinds & HistoryFromVertices)
+	{
+		TDF_Label FacesFromVerticesLabel = this->MakeChild(OperationLabel, HistoryKindTag(HistoryFromVertices));
+		AddTextToLabel(FacesFromVerticesLabel, "Faces from vertices");
+		std::vector<TDF_Label> labels = this->NewChildren(FacesFromVerticesLabel, History.GeneratedFromVertices.size());
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			AddTextToLabel(labels[i], "Generated face");
+			TNaming_Builder GeneratedBuilder(labels[i]);
+			GeneratedBuilder.Generated(History.GeneratedFromVertices[i].first, History.GeneratedFromVertices[i].second);
+			this->IndexNamedShape(labels[i]);
+		}
+	}
+
+	if (Kinds & HistoryFromFaces)
+	{
+		TDF_Label ShapesFromFacesLabel = this->MakeChild(OperationLabel, HistoryKindTag(HistoryFromFaces));
+		AddTextToLabel(ShapesFromFacesLabel, "Shapes from faces");
+		std::vector<TDF_Label> labels = this->NewChildren(ShapesFromFacesLabel, History.GeneratedFromFaces.size());
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			AddTextToLabel(labels[i], "Shape generated from Face");
+			TNaming_Builder GeneratedBuilder(labels[i]);
+			GeneratedBuilder.Generated(History.GeneratedFromFaces[i].first, History.GeneratedFromFaces[i].second);
+			this->IndexNamedShape(labels[i]);
+		}
+	}
+}
+
+void TopoNamingHelper::AppendNode(const TDF_Label& Parent, const TDF_Label& Target)
+{
+	TDF_Label NewNode = this->NewChild(Parent);
+	// Target may well be in another helper's Data Framework, in which case all of the
+	// relocations recorded here are useless afterwards, hence the throw-away table.
+	Handle(TDF_RelocationTable) relocations = new TDF_RelocationTable();
+	CopySubTree(Target, NewNode, relocations);
+	this->IndexSubTree(NewNode);
+}
+
+void TopoNamingHelper::MakeGeneratedNode(const TDF_Label& Parent, const TopoDS_Face& aFace)
+{
+	TDF_Label childLabel = this->NewChild(Parent);
+	TNaming_Builder Builder(childLabel);
+	Builder.Generated(aFace);
+	this->IndexNamedShape(childLabel);
+}
+
+void TopoNamingHelper::MakeGeneratedNodes(const TDF_Label& Parent, const std::vector<TopoDS_Face>& Faces)
+{
+	TDF_Label childLabel = this->NewChild(Parent);
+	this->AddTextToLabel(childLabel, "Generated Faces");
+
+	// Allocate all of the face labels up front so the TagSource is only bumped once,
+	// rather than once per face.
+	std::vector<TDF_Label> faceLabels = this->NewChildren(childLabel, Faces.size());
+	for (size_t i = 0; i < Faces.size(); i++)
 	{
-		this->MakeGeneratedNode(childLabel, aFace);
+		TNaming_Builder Builder(faceLabels[i]);
+		Builder.Generated(Faces[i]);
+		this->IndexNamedShape(faceLabels[i]);
 	}
 }
 
 void TopoNamingHelper::MakeGeneratedFromEdgeNode(const TDF_Label& Parent, const std::pair<TopoDS_Edge, TopoDS_Face>& aPair)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
+	TDF_Label childLabel = this->NewChild(Parent);
 	TNaming_Builder Builder(childLabel);
 	Builder.Generated(std::get<0>(aPair), std::get<1>(aPair));
+	this->IndexNamedShape(childLabel);
 }
 
 void TopoNamingHelper::MakeGeneratedFromEdgeNodes(const TDF_Label& Parent, const std::vector< std::pair<TopoDS_Edge, TopoDS_Face> >& Pairs)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
+	TDF_Label childLabel = this->NewChild(Parent);
 	this->AddTextToLabel(childLabel, "Faces Generated from Edges");
-	for (auto&& aPair : Pairs)
+	std::vector<TDF_Label> pairLabels = this->NewChildren(childLabel, Pairs.size());
+	for (size_t i = 0; i < Pairs.size(); i++)
 	{
-		this->MakeGeneratedFromEdgeNode(childLabel, aPair);
+		TNaming_Builder Builder(pairLabels[i]);
+		Builder.Generated(std::get<0>(Pairs[i]), std::get<1>(Pairs[i]));
+		this->IndexNamedShape(pairLabels[i]);
 	}
 }
 
 void TopoNamingHelper::MakeGeneratedFromVertexNode(const TDF_Label& Parent, const std::pair<TopoDS_Vertex, TopoDS_Face>& aPair)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
+	TDF_Label childLabel = this->NewChild(Parent);
 	TNaming_Builder Builder(childLabel);
 	Builder.Generated(std::get<0>(aPair), std::get<1>(aPair));
+	this->IndexNamedShape(childLabel);
 }
 
 void TopoNamingHelper::MakeGeneratedFromVertexNodes(const TDF_Label& Parent, const std::vector< std::pair<TopoDS_Vertex, TopoDS_Face> >& Pairs)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
+	TDF_Label childLabel = this->NewChild(Parent);
 	this->AddTextToLabel(childLabel, "Faces generated from Vertexes");
-	for (auto&& aPair : Pairs)
+	std::vector<TDF_Label> pairLabels = this->NewChildren(childLabel, Pairs.size());
+	for (size_t i = 0; i < Pairs.size(); i++)
 	{
-		this->MakeGeneratedFromVertexNode(childLabel, aPair);
+		TNaming_Builder Builder(pairLabels[i]);
+		Builder.Generated(std::get<0>(Pairs[i]), std::get<1>(Pairs[i]));
+		this->IndexNamedShape(pairLabels[i]);
 	}
 }
 
 void TopoNamingHelper::MakeModifiedNode(const TDF_Label& Parent, const std::pair<TopoDS_Face, TopoDS_Face>& aPair)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
+	TDF_Label childLabel = this->NewChild(Parent);
 	TNaming_Builder Builder(childLabel);
 	Builder.Modify(std::get<0>(aPair), std::get<1>(aPair));
+	this->IndexNamedShape(childLabel);
 }
 void TopoNamingHelper::MakeModifiedNodes(const TDF_Label& Parent, const std::vector< std::pair<TopoDS_Face, TopoDS_Face> >& aPairs)
 {
-	for (auto&& aPair : aPairs)
+	std::vector<TDF_Label> pairLabels = this->NewChildren(Parent, aPairs.size());
+	for (size_t i = 0; i < aPairs.size(); i++)
 	{
-		this->MakeModifiedNode(Parent, aPair);
+		TNaming_Builder Builder(pairLabels[i]);
+		Builder.Modify(std::get<0>(aPairs[i]), std::get<1>(aPairs[i]));
+		this->IndexNamedShape(pairLabels[i]);
 	}
 }
 void TopoNamingHelper::MakeDeletedNode(const TDF_Label& Parent, const TopoDS_Face& aFace)
 {
-	TDF_Label childLabel = TDF_TagSource::NewChild(Parent);
+	TDF_Label childLabel = this->NewChild(Parent);
 	TNaming_Builder Builder(childLabel);
 	Builder.Delete(aFace);
+	this->IndexNamedShape(childLabel);
 }
 void TopoNamingHelper::MakeDeletedNodes(const TDF_Label& Parent, const std::vector<TopoDS_Face>& Faces)
 {
-	for (auto&& aFace : Faces)
+	std::vector<TDF_Label> faceLabels = this->NewChildren(Parent, Faces.size());
+	for (size_t i = 0; i < Faces.size(); i++)
 	{
-		this->MakeDeletedNode(Parent, aFace);
+		TNaming_Builder Builder(faceLabels[i]);
+		Builder.Delete(Faces[i]);
+		this->IndexNamedShape(faceLabels[i]);
 	}
 }
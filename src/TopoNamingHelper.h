@@ -3,24 +3,43 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <functional>
+#include <ostream>
+#include <type_traits>
+#include <unordered_map>
 
 #include <TNaming.hxx>
 #include <TNaming_Builder.hxx>
 
 #include <TDF_Data.hxx>
 #include <TDF_Label.hxx>
+#include <TDF_LabelMap.hxx>
+#include <TDF_RelocationTable.hxx>
 #include <TDF_TagSource.hxx>
 
+#include <Bnd_Box.hxx>
+#include <gp_Pnt.hxx>
 #include <TopoDS_Shape.hxx>
 #include <TopoDS_Vertex.hxx>
 #include <TopTools_Array1OfListOfShape.hxx>
 #include <TopTools_ListOfShape.hxx>
+#include <TopTools_ListIteratorOfListOfShape.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
 
+#include <BRepBuilderAPI_MakeShape.hxx>
+
+#include <BRepAlgoAPI_BooleanOperation.hxx>
 #include <BRepAlgoAPI_Cut.hxx>
 #include <BRepAlgoAPI_Fuse.hxx>
 #include <BRepFilletAPI_MakeFillet.hxx>
 
 #include "TopoNamingData.h"
+#include "TopologyIndex.h"
+#include "ShapeHasher.h"
+#include "GeometricSignature.h"
+#include "OperationTraits.h"
+#include "TopoNamingState.h"
 
 class TopoNamingHelper
 {
@@ -29,7 +48,39 @@ public:
 	TopoNamingHelper(const TopoNamingHelper& existing);
 	~TopoNamingHelper();
 
+	// NOTE: copies (and operator =) share one history: a change made through either one is
+	// seen by both. Use Fork for an independent history.
 	void operator = (const TopoNamingHelper&);
+	// A new helper whose history starts out identical to this one but is independent of
+	// it from then on. This is cheap: the two keep sharing the same Data Framework until
+	// either of them changes it. Only then does that one make its own copy, of the whole
+	// Data Framework, which takes time in proportion to the length of the history.
+	TopoNamingHelper Fork() const;
+	// Collapse every run of consecutive operation nodes that only modify shapes, and that
+	// no selection refers to, into one node with the same net effect. The history is
+	// re-written into a fresh Data Framework, so the shapes that only those nodes held
+	// on to get released. Selection tags stay the same, but operation nodes after the
+	// first collapsed run get new tags. Returns how many operation nodes went away.
+	// NOTE: Compact can't be undone, and every undo/redo step recorded before it is
+	// dropped, since a TDF_Delta only applies to the Data Framework it was made in.
+	size_t Compact();
+
+	// Every Track*, Select*, AddNode and Append* call is one TDF transaction, whose
+	// TDF_Delta is kept so that it can be undone (and redone) later without recomputing
+	// any geometry. A call that throws is rolled back. Only the most recent steps are
+	// kept, see SetUndoLimits, and Fork and Compact start over with none. Each returns
+	// false if there was nothing to undo/redo.
+	// NOTE: anything written straight to the Data Framework (i.e. under GetRootNode or
+	// GetSelectionNode) isn't in any of the steps. Undoing past it would leave it pointing
+	// at whatever was undone, so as soon as a new label turns up outside of a transaction
+	// all of the undo/redo steps are dropped.
+	bool Undo();
+	bool Redo();
+	bool CanUndo() const;
+	bool CanRedo() const;
+	// Keep at most MaxSteps undo steps, and drop the oldest ones if they add up to more than
+	// MaxAttributeDeltas changed attributes
+	void SetUndoLimits(const size_t& MaxSteps, const size_t& MaxAttributeDeltas);
 
 	// TODO Need to add methods for tracking a translation to a shape.
 	// Make changes to the Data Framework to track Topological Changes
@@ -37,15 +88,34 @@ public:
 	void TrackGeneratedShape(const TopoDS_Shape& GeneratedShape, const std::string& name);
 	void TrackGeneratedShape(const TopoDS_Shape& GeneratedShape, const TopoData& TData, const std::string& name);
 	TDF_Label TrackGeneratedShape(const std::string& parent_tag, const TopoDS_Shape& GeneratedShape, const TopoData& TData, const std::string& name);
+	TDF_Label TrackGeneratedShape(const TDF_Label& parent, const TopoDS_Shape& GeneratedShape, const TopoData& TData, const std::string& name);
 	TDF_Label TrackGeneratedShape(const std::string& parent_tag, const TopoDS_Shape& GeneratedShape, const FilletData& FData, const std::string& name);
-	//void TrackFuseOperation(BRepAlgoAPI_Fuse& Fuser);
+	// Run a Fuse/Cut/Common (whichever Operator is) on any number of Arguments and Tools,
+	// in parallel, and track it. The result is stored as a modification of the first
+	// argument, with a sub-node for the history of each input. The section edges are
+	// recorded as generated from the faces that intersect.
+	TDF_Label TrackBooleanOperation(BRepAlgoAPI_BooleanOperation& Operator, const std::vector<TopoDS_Shape>& Arguments,
+									const std::vector<TopoDS_Shape>& Tools, const std::string& name);
+	// Track any BRepBuilderAPI_MakeShape (fillet, chamfer, prism, revol, boolean,
+	// offset...) that has been built from BaseShape. A new node is added under the Root
+	// holding mkShape.Shape() as a modification of BaseShape (or as generated from it, for
+	// sweeps), with one sub-node per kind of history that OperationTraits<Maker> says the
+	// Maker can report.
+	template <typename Maker>
+	TDF_Label TrackOperation(const TopoDS_Shape& BaseShape, Maker& mkShape, const std::string& name);
 	void TrackFilletOperation(const TopoDS_Shape& BaseShape, TopoDS_Shape& ResultShape, BRepFilletAPI_MakeFillet& Filleter);
 	void TrackModifiedShape(const TopoDS_Shape& NewShape, const TopoData& TData, const std::string& name);
 	void TrackModifiedShape(const std::string& OrigShapeNodeTag, const TopoDS_Shape& NewShape, const TopoData& TData, const std::string& name);
+	void TrackModifiedShape(const TDF_Label& OrigShapeNode, const TopoDS_Shape& NewShape, const TopoData& TData, const std::string& name);
 	void TrackModifiedFilletBaseShape(const TopoDS_Shape& NewBaseShape);
 	std::string SelectEdge(const TopoDS_Edge& anEdge, const TopoDS_Shape& aShape);
 	std::string SelectEdge(const TopoDS_Edge& anEdge, const TopoDS_Shape& aShape, TNaming_Selector& selector, TDF_Label& selectionLabel);
 	std::vector<std::string> SelectEdges(const std::vector<TopoDS_Edge> Edges, const TopoDS_Shape& aShape);
+	// Select every one of SubShapes (Faces, Edges or Vertexes of Context) at once. Shapes
+	// that were already selected in the same Context re-use their existing selection, and
+	// shapes the history already identifies get that label, like SelectEdge. Returns the
+	// selection label for each entry of SubShapes, in the same order.
+	std::vector<TDF_Label> SelectBatch(const std::vector<TopoDS_Shape>& SubShapes, const TopoDS_Shape& Context);
 	// NOTE: This function is very fragile right now. It assumes that InputData is
 	// the same as BaseRoot plus zero or more evolution nodes. It simply adds to
 	// BaseRoot any nodes that it doesn't have. It doesn't check anything else!!!
@@ -54,14 +124,36 @@ public:
 
 	// Various helper functions
 
+	// NOTE: the accessors below all come in two flavours. The TDF_Label ones are the
+	// ones to use internally and in loops, the std::string tag ones (i.e. "0:2:1") are
+	// there for convenience and just convert the tag to a TDF_Label first.
+
+	// Convert between a tag such as "0:2:1" and the TDF_Label it refers to
+	TDF_Label GetLabel(const std::string& tag) const;
+	static std::string GetTag(const TDF_Label& Label);
+
 	// Returns the edge at the NodeTag, i.e. "0:2"
 	TopoDS_Edge GetSelectedEdge(const std::string NodeTag) const;
+	TopoDS_Edge GetSelectedEdge(const TDF_Label& EdgeNode) const;
+	// Same as above, but if TNaming can't solve the selection the edge is looked for in
+	// NewContext by its geometric signature. The other overloads use the tip shape.
+	TopoDS_Edge GetSelectedEdge(const TDF_Label& EdgeNode, const TopoDS_Shape& NewContext) const;
+	// Solve every selection in SelectionLabels and return the shapes in the same order.
+	// Selections that depend on one another are solved in dependency order.
+	// NOTE: solving (here and in GetSelectedEdge) doesn't change the Data Framework.
+	// TNaming_Selector::Solve re-writes the selection's NamedShape, but that's rolled back
+	// once the solved shape has been read.
+	std::vector<TopoDS_Shape> SolveSelections(const std::vector<TDF_Label>& SelectionLabels) const;
+	// Goes up by at least one every time the history tree changes
+	unsigned long GetHistoryVersion() const;
 	// Returns the Context Shape for selected edge located at NodeTag: TODO does this
 	// work 100% of the time? It seems sometimes the sub-node is NOT the context
 	// shape...
 	TopoDS_Shape GetSelectedBaseShape(const std::string NodeTag) const;
+	TopoDS_Shape GetSelectedBaseShape(const TDF_Label& EdgeNode) const;
 	// Return the TopoDS_Shape stored in the NodeTag, i.e. "0:4"
 	TopoDS_Shape GetNodeShape(const std::string NodeTag) const;
+	TopoDS_Shape GetNodeShape(const TDF_Label& Node) const;
 	// Intended to be used for a Data Framework that is keeping track of the evolution
 	// of a Filleted shape. If the Data Framework does not contain a Fillet node, this
 	// method may not work as expected
@@ -75,6 +167,13 @@ public:
 	std::string GetNode(const int& n) const;
 	// get the tag to the Nth child node from the Parent label.
 	std::string GetNode(const std::string& tag, const int& n) const;
+	// Same as GetNode, but return the TDF_Label itself
+	TDF_Label GetNodeLabel(const int& n) const;
+	TDF_Label GetNodeLabel(const TDF_Label& Parent, const int& n) const;
+	// How many children Parent has. Labels are never removed from a Data Framework, so
+	// after an Undo NbChildren still counts the undone ones, but the TagSource doesn't.
+	// Use this rather than TDF_Label::NbChildren.
+	static int CountChildren(const TDF_Label& Parent);
 	// Does the Topo tree have additional nodes aside from the Selection one created
 	// at initialization?
 	bool HasNodes() const;
@@ -83,15 +182,55 @@ public:
 	void AddNode(const std::string& Name = "");
 	//TopoDS_Shape GetGeneratedShape(const TDF_Label& parent, const int& node);
 	TopoDS_Shape GetLatestShape(const std::string& tag);
+	TopoDS_Shape GetLatestShape(const TDF_Label& Node);
 	//TopoDS_Shape GetModifiedNewShape(const TDF_Label& parent, const int& node);
 
 	// Non-Member Class functions
 	static bool CompareTwoFaceTopologies(const TopoDS_Shape& face1, const TopoDS_Shape& face2);
+	// Same as CompareTwoFaceTopologies, but each face's SurfaceFingerprint is only
+	// computed once and then cached (the 4096 most recently used are kept). Not thread
+	// safe, same as GetTopologyIndex.
+	bool CompareFaces(const TopoDS_Face& face1, const TopoDS_Face& face2) const;
+	// Work out which faces of OldShape were modified or deleted and which faces of
+	// NewShape are new, for any two shapes. Faces are paired up on the same surface first
+	// and by position second. Faces that didn't change at all are left out. The result
+	// can be passed straight to TrackModifiedShape.
+	TopoData DiffShapes(const TopoDS_Shape& OldShape, const TopoDS_Shape& NewShape) const;
+	TopoData DiffShapes(const std::vector<TopoDS_Face>& OldFaces, const std::vector<TopoDS_Face>& NewFaces) const;
 	static bool CompareTwoEdgeTopologies(const TopoDS_Edge& edge1, const TopoDS_Edge& edge2, int numCheckPoints = 10);
 	static void WriteShape(const TopoDS_Shape& aShape, const std::string& NameBase, const int& numb = -1);
+	// Record OldShape -> NewShape in Builder the way Evolution says to
+	static void Replay(TNaming_Builder& Builder, const TNaming_Evolution& Evolution, const TopoDS_Shape& OldShape, const TopoDS_Shape& NewShape);
+
+	// Save the whole history, shapes and all, to one binary file (see HistoryArchive.h),
+	// and load it back. Load replaces whatever history this helper had, so the tags it
+	// hands out afterwards are the ones from the file.
+	void Save(const std::string& FileName) const;
+	void Load(const std::string& FileName);
 
-	TDF_Label GetRootNode() { return myRootNode; }
-	TDF_Label GetSelectionNode() { return mySelectionNode; }
+	// Every label in the Data Framework whose NamedShape mentions aShape (same TShape,
+	// Location and Orientation), oldest first. This is a hash lookup, no tree walking.
+	std::vector<ShapeReference> GetShapeHistory(const TopoDS_Shape& aShape) const;
+	// The label that most recently Generated or Modified aShape, or a null label if
+	// aShape isn't in the history.
+	TDF_Label FindCreatingNode(const TopoDS_Shape& aShape) const;
+
+	// Returns the Faces, Edges and Vertexes of aShape. The index is built the first time
+	// a given shape (TShape + Location) is asked for and re-used after that, so every
+	// Track*, Select* and Get*Data call on the same shape only walks it once. Only the 32
+	// most recently used indexes are kept.
+	// NOTE: even though this is const it updates the cache, so like the rest of this
+	// class it must not be called from more than one thread at a time.
+	std::shared_ptr<const TopologyIndex> GetTopologyIndex(const TopoDS_Shape& aShape) const;
+	// Every Face or Edge (aType) of Context whose bounding box intersects aBox
+	std::vector<TopoDS_Shape> FindSubShapesInBox(const TopoDS_Shape& Context, const TopAbs_ShapeEnum& aType, const Bnd_Box& aBox) const;
+	// The Face or Edge (aType) of Context closest to aPoint, or a null shape if there isn't one
+	TopoDS_Shape FindNearestSubShape(const TopoDS_Shape& Context, const TopAbs_ShapeEnum& aType, const gp_Pnt& aPoint) const;
+
+	// These hand out labels that the caller may write to, so like any other change they
+	// give a forked helper its own copy of the history first.
+	TDF_Label GetRootNode();
+	TDF_Label GetSelectionNode();
 
 	// debugging stuff
 
@@ -101,17 +240,137 @@ public:
 	// A custom Dump function that is more concise and informative than the OCC one
 	std::string DeepDump() const;
 	std::string DeepDump2() const;
-	void DeepDump(std::stringstream& stream) const;
-	void DeepDump2(std::stringstream& stream) const;
+	void DeepDump(std::ostream& stream) const;
+	void DeepDump2(std::ostream& stream) const;
+	// Same as above, but written straight to a file descriptor (i.e. STDERR_FILENO or an
+	// open file) as the tree is walked
+	void DeepDump2(int fd) const;
 	// Dump the whole Data Framework and attributes too
 	std::string DFDump() const;
 
+	// Structured versions of the dumps above, for other tools to load. Visit is called for
+	// every label in the history, parents before children.
+	void ForEachHistoryRecord(const std::function<void(const HistoryRecord&)>& Visit) const;
+	// Every HistoryRecord, little-endian: the magic "TNHX" and a uint32 version (1), then
+	// per record a uint32 byte count followed by that many bytes of
+	//     uint32 depth, int32 tag * depth, int32 evolution,
+	//     uint32 pairs, (uint32 old id, uint32 new id) * pairs, uint32 length, text
+	void ExportBinary(std::ostream& stream) const;
+	// Every HistoryRecord as one line of JSON, i.e.
+	// {"path":"0:2:1","evolution":"MODIFY","shapes":[[1,2]],"text":"Modified faces"}
+	// where evolution is null if the label doesn't have a NamedShape
+	void ExportNDJSON(std::ostream& stream) const;
+
 	std::string GetTextFromLabel(const TDF_Label& Label) const;
 
 private:
 	// This helps make the DeepDump output more legible
 	void AddTextToLabel(const TDF_Label& Label, const std::string& name, const std::string& extra = "");
 	bool CheckIfSelectionExists(const TDF_Label aNode, const TopoDS_Face aFace) const;
+	// Returns the direct child of aNode that is a selection of aShape in Context, or a
+	// null label. A null Context matches a selection in any context.
+	TDF_Label FindSelection(const TDF_Label& aNode, const TopoDS_Shape& aShape, const TopoDS_Shape& Context = TopoDS_Shape()) const;
+	// Do the edges of face1 and face2 match up one to one?
+	static bool CompareFaceEdges(const TopoDS_Shape& face1, const TopoDS_Shape& face2);
+	SurfaceFingerprint GetSurfaceFingerprint(const TopoDS_Face& aFace) const;
+	// Run TNaming_Selector::Solve on SelectionLabel using the labels in Valid as scope.
+	// If that fails, fall back to ResolveBySignature in Context (or the tip shape if
+	// Context is null). The result is cached until the history version changes, separately
+	// for an empty Valid and a Valid holding the whole tree (the only two the callers
+	// use), and for each Context. Has to be called inside a ScratchTransaction.
+	TopoDS_Shape SolveSelection(const TDF_Label& SelectionLabel, TDF_LabelMap& Valid, const TopoDS_Shape& Context) const;
+	// Find the edge in Context that best matches the geometric signature stored on
+	// SelectionLabel. Returns a null shape if there's no signature or no match.
+	TopoDS_Shape ResolveBySignature(const TDF_Label& SelectionLabel, const TopoDS_Shape& Context) const;
+	// Store the geometric signature of aShape (if it's an edge of Context) on SelectionLabel
+	void StoreSelectionSignature(const TDF_Label& SelectionLabel, const TopoDS_Shape& aShape, const TopoDS_Shape& Context);
+	// Indices into SelectionLabels in an order that solves dependencies first
+	std::vector<size_t> OrderSelections(const std::vector<TDF_Label>& SelectionLabels) const;
+	// Wraps one Track* call in a TDF transaction, see Undo. Only the outermost one in a
+	// call does anything, so Track* methods can call each other. Commit has to be called
+	// once everything is written, otherwise (i.e. if an exception is on its way through)
+	// the transaction is aborted on the way out.
+	class Transaction
+	{
+	public:
+		explicit Transaction(TopoNamingHelper& Helper);
+		~Transaction();
+		void Commit();
+	private:
+		TopoNamingHelper& myHelper;
+		bool myOpened = false;
+	};
+	// Opens a transaction that is always aborted, so that whatever gets written to the
+	// Data Framework while it's open (i.e. by TNaming_Selector::Solve) leaves no trace.
+	// The Data Framework's time is back where it was afterwards, so the undo steps still
+	// apply. Unlike Transaction these can be nested in anything.
+	class ScratchTransaction
+	{
+	public:
+		explicit ScratchTransaction(const TopoNamingHelper& Helper);
+		~ScratchTransaction();
+	private:
+		Handle(TDF_Data) myData;
+	};
+	// Does the work for the DeepDump2's. The output is handed to Sink a chunk at a time.
+	void WriteDeepDump2(const std::function<void(const char*, size_t)>& Sink) const;
+	// i.e. "MODIFY" for TNaming_MODIFY
+	static const char* EvolutionName(const TNaming_Evolution& Evolution);
+	// Add a delta to the undo steps and drop the oldest ones that go over the limits
+	void PushUndoDelta(const Handle(TDF_Delta)& Delta);
+	// Re-build ShapeToLabels from scratch, in tag order, after Load replaced the tree
+	void RebuildIndex();
+	// Bring ShapeToLabels up to date after Delta was undone or redone (or its transaction
+	// aborted). Only the labels whose NamedShape it touched are looked at, and references
+	// that are still there keep their place, so the index stays in recorded order.
+	void ReindexDelta(const Handle(TDF_Delta)& Delta);
+	// Note down the TagSource's of the Root and Selection nodes at the end of a transaction,
+	// so that UndoStepsValid can tell if any labels were added outside of one since
+	void RecordUndoTags();
+	// Whether the undo/redo steps still apply. If not, they are dropped.
+	bool UndoStepsValid();
+	// Add every shape in the NamedShape at Label to the ShapeToLabels index. Has to be
+	// called whenever a TNaming_Builder or TNaming_Selector writes to a label.
+	void IndexNamedShape(const TDF_Label& Label);
+	// If OldShape's TopologyIndex is cached, let NewShape's index re-use whatever of its
+	// bounding volume hierarchies it can. Called whenever NewShape is recorded as a
+	// modification of OldShape.
+	void CarryOverTopologyIndex(const TopoDS_Shape& OldShape, const TopoDS_Shape& NewShape) const;
+	// If this helper's history is still shared with a fork, copy it so that it can be
+	// changed. Has to be called before anything is written to the Data Framework.
+	void EnsureUnshared();
+	// aLabel if it's in this helper's Data Framework, otherwise the label with the same tag
+	// in it. Labels handed out before EnsureUnshared made a copy still point at the old one.
+	TDF_Label Relocate(const TDF_Label& aLabel) const;
+	// Copy Source, all of its attributes, and all of its sub-labels to Target, keeping the
+	// same tags. The TopoDS_Shapes in the NamedShapes are the very same ones, not copies.
+	// Every label and attribute copied is recorded in Relocations. The NamedShapes are
+	// re-built in Order if there is one (see RecordedOrder), otherwise in tag order with
+	// the selections last.
+	static void CopySubTree(const TDF_Label& Source, const TDF_Label& Target, const Handle(TDF_RelocationTable)& Relocations,
+							const LabelOrder* Order = nullptr);
+	// The order the labels of State were recorded in, as far as its ShapeToLabels tells,
+	// and tag order for the rest
+	static LabelOrder RecordedOrder(const TopoNamingState& State);
+	// IndexNamedShape for Parent and everything under it, in tag order
+	void IndexSubTree(const TDF_Label& Parent);
+	// Fill ShapeToLabels in for a tree that was copied out of Source's one, by pointing
+	// Source's references at the copied labels, so they stay in the order they were
+	// recorded in. Whatever ShapeToLabels already holds was written under the operation
+	// nodes that CollapsedInto maps the missing ones to, and goes in their place.
+	void RelocateIndex(const ShapeIndex& Source, const Handle(TDF_RelocationTable)& Relocations,
+					   const std::unordered_map<TDF_Label, TDF_Label, LabelHasher, LabelIsEqual>& CollapsedInto);
+	// The child of the Root node that aLabel is under (or is)
+	static TDF_Label OperationOf(const TDF_Label& aLabel);
+	// Whether the operation node OperationLabel (a child of the Root node) is a plain
+	// modification of the shape before it, that Compact may collapse into its neighbours
+	static bool IsModification(const TDF_Label& OperationLabel);
+	// Every operation node that a selection refers to, directly or through its shapes
+	TDF_LabelMap ReferencedOperations() const;
+	// Write the net effect of the operation nodes in Run to CompactedLabel
+	void WriteCompactedRun(const std::vector<TDF_Label>& Run, const TDF_Label& CompactedLabel);
+	// Mark the history tree as changed, which invalidates any solved selections
+	void BumpHistoryVersion();
 	// Get TopoDS_Shape stored in the nth node under the passed Label
 	TopoDS_Shape GetChildShape(const TDF_Label& ParentLabel, const int& n) const;
 	// Write out a BREP file of the TopoDS_Shape at aLabel. The file will be named
@@ -121,8 +380,34 @@ private:
 	// <NodeTag>. if <Deep> is true, also write out for all children, with
 	// <NameBase>_1.brep, <NameBase>_2.brep etc... as the filename.
 	void WriteNode(const std::string NodeTag, const std::string NameBase, const bool Deep) const;
+	// Resolve a tag through the TagToLabel cache, falling back to TDF_Tool::Label
 	TDF_Label LabelFromTag(const std::string& tag) const;
-	//void AppendNode(const TDF_Label& Parent, const TDF_Label& Target, const int& depth=0);
+	// Must be called whenever labels are forgotten or undone
+	void InvalidateTagCache();
+	// Same as TDF_TagSource::NewChild, but the new label is also added to the tag cache
+	TDF_Label NewChild(const TDF_Label& Parent);
+	// Same as NewChild, but for a given Tag rather than the next free one. The TagSource
+	// is moved past Tag if it isn't already.
+	TDF_Label MakeChild(const TDF_Label& Parent, const int& Tag);
+	// Create n new children under Parent, as if TDF_TagSource::NewChild was called n
+	// times in a row.
+	std::vector<TDF_Label> NewChildren(const TDF_Label& Parent, const size_t& n);
+	// Collect the Modified/Deleted/Generated history from mkShape without touching the
+	// Data Framework. Only the queries enabled in OperationTraits<Maker> are run.
+	template <typename Maker>
+	OperationHistory GatherHistory(const TopoDS_Shape& BaseShape, Maker& mkShape) const;
+	template <typename Maker>
+	static void GatherGenerated(const TopTools_IndexedMapOfShape& Shapes, Maker& mkShape,
+								std::vector<std::pair<TopoDS_Shape, TopoDS_Shape>>& Out);
+	// Write a gathered OperationHistory under a new node below the Root. Kinds is a
+	// combination of OperationHistoryKind, one sub-node is created for each. If Kinds
+	// doesn't include HistoryModified, ResultShape is recorded as generated from BaseShape.
+	TDF_Label CommitHistory(const TopoDS_Shape& BaseShape, const TopoDS_Shape& ResultShape,
+							const OperationHistory& History, const int Kinds, const std::string& name);
+	// Write the sub-nodes of a gathered OperationHistory below OperationLabel
+	void WriteHistory(const TDF_Label& OperationLabel, const OperationHistory& History, const int Kinds);
+	// Copy Target, with all of its sub-nodes, shapes and text, to a new child of Parent.
+	// Target doesn't need to be in this helper's Data Framework.
 	void AppendNode(const TDF_Label& Parent, const TDF_Label& Target);
 
 	// These are used for adding the respective types of Nodes to a parent Node
@@ -139,8 +424,92 @@ private:
 	//bool NodesAreEqual(const TDF_Label& Node1, const TDF_Label& Node2) const;
 
 	// Finally, class member variables
-	Handle(TDF_Data) myDataFramework = new TDF_Data();
-	TDF_Label myRootNode = myDataFramework->Root();
-	TDF_Label mySelectionNode;
+	std::shared_ptr<TopoNamingHistory> myHistory = std::make_shared<TopoNamingHistory>();
+	mutable ShapeLRUCache<std::shared_ptr<const TopologyIndex>> myTopologyIndexes{ 32 };
+	// Same idea as myTopologyIndexes, but faces are a lot more plentiful
+	mutable ShapeLRUCache<SurfaceFingerprint> myFaceFingerprints{ 4096 };
 };
+
+template <typename Maker>
+TDF_Label TopoNamingHelper::TrackOperation(const TopoDS_Shape& BaseShape, Maker& mkShape, const std::string& name)
+{
+	Transaction transaction(*this);
+	OperationHistory history = this->GatherHistory(BaseShape, mkShape);
+	TDF_Label OperationLabel = this->CommitHistory(BaseShape, mkShape.Shape(), history, OperationTraits<Maker>::Kinds, name);
+	transaction.Commit();
+	return OperationLabel;
+}
+
+template <typename Maker>
+OperationHistory TopoNamingHelper::GatherHistory(const TopoDS_Shape& BaseShape, Maker& mkShape) const
+{
+	static_assert(std::is_base_of<BRepBuilderAPI_MakeShape, Maker>::value,
+				  "TrackOperation only works with a BRepBuilderAPI_MakeShape");
+	const int Kinds = OperationTraits<Maker>::Kinds;
+
+	// NOTE: this has to stay on a single thread. Generated and Modified hand back a
+	// reference to the same list inside the BRepBuilderAPI_MakeShape, which gets
+	// overwritten on every call, so two queries at once would stomp on each other.
+	OperationHistory history;
+	std::shared_ptr<const TopologyIndex> baseIndex = this->GetTopologyIndex(BaseShape);
+
+	if (Kinds & HistoryFromEdges)
+	{
+		GatherGenerated(baseIndex->Edges(), mkShape, history.GeneratedFromEdges);
+	}
+
+	if (Kinds & (HistoryModified | HistoryDeleted))
+	{
+		const TopTools_IndexedMapOfShape& mapOfFaces = baseIndex->Faces();
+		for (int i = 1; i <= mapOfFaces.Extent(); i++)
+		{
+			const TopoDS_Shape& curFace = mapOfFaces.FindKey(i);
+			if (Kinds & HistoryModified)
+			{
+				TopTools_ListIteratorOfListOfShape it(mkShape.Modified(curFace));
+				for (; it.More(); it.Next())
+				{
+					if (!curFace.IsSame(it.Value()))
+					{
+						history.ModifiedFaces.push_back({ curFace, it.Value() });
+					}
+				}
+			}
+
+			if ((Kinds & HistoryDeleted) && mkShape.IsDeleted(curFace))
+			{
+				history.DeletedFaces.push_back(curFace);
+			}
+		}
+	}
+
+	if (Kinds & HistoryFromVertices)
+	{
+		GatherGenerated(baseIndex->Vertices(), mkShape, history.GeneratedFromVertices);
+	}
+
+	if (Kinds & HistoryFromFaces)
+	{
+		GatherGenerated(baseIndex->Faces(), mkShape, history.GeneratedFromFaces);
+	}
+	return history;
+}
+
+template <typename Maker>
+void TopoNamingHelper::GatherGenerated(const TopTools_IndexedMapOfShape& Shapes, Maker& mkShape,
+									   std::vector<std::pair<TopoDS_Shape, TopoDS_Shape>>& Out)
+{
+	for (int i = 1; i <= Shapes.Extent(); i++)
+	{
+		const TopoDS_Shape& curShape = Shapes.FindKey(i);
+		TopTools_ListIteratorOfListOfShape it(mkShape.Generated(curShape));
+		for (; it.More(); it.Next())
+		{
+			if (!curShape.IsSame(it.Value()))
+			{
+				Out.push_back({ curShape, it.Value() });
+			}
+		}
+	}
+}
 #endif /* ifndef TOPONAMINGHELPER_H */
@@ -0,0 +1,135 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef TOPO_NAMING_LOG_H
+#define TOPO_NAMING_LOG_H
+
+#include <atomic>
+#include <iostream>
+
+// Logging for the topological naming code. Every message has a level and a category:
+//
+//     TN_LOG_DEBUG(TopoNamingLog::Selection, "Selecting edge " << tag);
+//
+// Messages above TOPO_NAMING_LOG_LEVEL (set at build time, see CMakeLists.txt) are
+// compiled out entirely, arguments and all. The rest are checked against the runtime
+// filter (SetLevel and SetCategories), which is a single atomic load, and the arguments
+// are only evaluated if the message is actually going to be written.
+#define TN_LOG_LEVEL_ERROR 0
+#define TN_LOG_LEVEL_WARNING 1
+#define TN_LOG_LEVEL_INFO 2
+#define TN_LOG_LEVEL_DEBUG 3
+
+#ifndef TOPO_NAMING_LOG_LEVEL
+#define TOPO_NAMING_LOG_LEVEL TN_LOG_LEVEL_DEBUG
+#endif
+
+namespace TopoNamingLog
+{
+	enum Level
+	{
+		Error = TN_LOG_LEVEL_ERROR,
+		Warning = TN_LOG_LEVEL_WARNING,
+		Info = TN_LOG_LEVEL_INFO,
+		Debug = TN_LOG_LEVEL_DEBUG
+	};
+
+	enum Category
+	{
+		// Recording history, i.e. the Track* methods
+		Tracking = 1 << 0,
+		// Making selections
+		Selection = 1 << 1,
+		// Solving selections and retrieving shapes from the history
+		Solve = 1 << 2,
+		// Dumps and writing files
+		IO = 1 << 3,
+		AllCategories = Tracking | Selection | Solve | IO
+	};
+
+	// The level lives in the top byte and the categories in the rest, so that checking both
+	// only takes the one load
+	inline std::atomic<unsigned>& Filter()
+	{
+		static std::atomic<unsigned> filter((static_cast<unsigned>(Warning) << 24) | AllCategories);
+		return filter;
+	}
+
+	inline bool Enabled(const Level& level, const Category& category)
+	{
+		const unsigned filter = Filter().load(std::memory_order_relaxed);
+		return static_cast<unsigned>(level) <= (filter >> 24) && (filter & category) != 0;
+	}
+
+	// Show messages up to and including level. Defaults to Warning.
+	inline void SetLevel(const Level& level)
+	{
+		unsigned filter = Filter().load(std::memory_order_relaxed);
+		while (!Filter().compare_exchange_weak(filter, (static_cast<unsigned>(level) << 24) | (filter & 0xFFFFFF)))
+		{}
+	}
+
+	// Only show messages in these categories (OR'ed together). Defaults to AllCategories.
+	inline void SetCategories(const unsigned& categories)
+	{
+		unsigned filter = Filter().load(std::memory_order_relaxed);
+		while (!Filter().compare_exchange_weak(filter, (filter & 0xFF000000) | (categories & 0xFFFFFF)))
+		{}
+	}
+
+	// Where messages go. They end with '\n' rather than std::endl, so writing one doesn't
+	// flush the stream.
+	inline std::ostream& Stream()
+	{
+		return std::clog;
+	}
+}
+
+#define TN_LOG(level, category, message) \
+	do \
+	{ \
+		if (TopoNamingLog::Enabled(level, category)) \
+		{ \
+			TopoNamingLog::Stream() << message << '\n'; \
+		} \
+	} while (0)
+
+#define TN_LOG_NOTHING() do {} while (0)
+
+#if TOPO_NAMING_LOG_LEVEL >= TN_LOG_LEVEL_ERROR
+#define TN_LOG_ERROR(category, message) TN_LOG(TopoNamingLog::Error, category, message)
+#else
+#define TN_LOG_ERROR(category, message) TN_LOG_NOTHING()
+#endif
+
+#if TOPO_NAMING_LOG_LEVEL >= TN_LOG_LEVEL_WARNING
+#define TN_LOG_WARNING(category, message) TN_LOG(TopoNamingLog::Warning, category, message)
+#else
+#define TN_LOG_WARNING(category, message) TN_LOG_NOTHING()
+#endif
+
+#if TOPO_NAMING_LOG_LEVEL >= TN_LOG_LEVEL_INFO
+#define TN_LOG_INFO(category, message) TN_LOG(TopoNamingLog::Info, category, message)
+#else
+#define TN_LOG_INFO(category, message) TN_LOG_NOTHING()
+#endif
+
+#if TOPO_NAMING_LOG_LEVEL >= TN_LOG_LEVEL_DEBUG
+#define TN_LOG_DEBUG(category, message) TN_LOG(TopoNamingLog::Debug, category, message)
+#else
+#define TN_LOG_DEBUG(category, message) TN_LOG_NOTHING()
+#endif
+#endif /* ifndef TOPO_NAMING_LOG_H */
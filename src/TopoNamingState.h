@@ -0,0 +1,121 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef TOPO_NAMING_STATE_H
+#define TOPO_NAMING_STATE_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <TDF_Data.hxx>
+#include <TDF_Delta.hxx>
+#include <TDF_Label.hxx>
+#include <TDF_LabelMapHasher.hxx>
+#include <TNaming_Evolution.hxx>
+#include <TopoDS_Shape.hxx>
+
+#include "ShapeHasher.h"
+
+// One label whose TNaming_NamedShape mentions a given shape
+struct ShapeReference
+{
+	TDF_Label Label;
+	TNaming_Evolution Evolution;
+	// true if the shape is the 'new' shape on that label, false if it's the 'old' one
+	bool IsNewShape;
+};
+
+// The result of solving a selection, along with what it was solved with: the history
+// version, whether the scope was the whole tree (rather than empty), and the context
+// that the geometric fallback searched in
+struct SolvedSelection
+{
+	unsigned long Version;
+	bool WholeTree;
+	TopoDS_Shape Context;
+	TopoDS_Shape Shape;
+};
+
+struct LabelHasher
+{
+	size_t operator()(const TDF_Label& aLabel) const
+	{
+		return static_cast<size_t>(TDF_LabelMapHasher::HashCode(aLabel, IntegerLast()));
+	}
+};
+
+struct LabelIsEqual
+{
+	bool operator()(const TDF_Label& aLabel, const TDF_Label& anotherLabel) const
+	{
+		return aLabel.IsEqual(anotherLabel);
+	}
+};
+
+// shape (TShape, Location and Orientation) -> every label that references it, in the
+// order they were recorded
+typedef std::unordered_map<TopoDS_Shape, std::vector<ShapeReference>, ShapeHasher, ShapeIsEqual> ShapeIndex;
+// label -> its place in some order of labels
+typedef std::unordered_map<TDF_Label, size_t, LabelHasher, LabelIsEqual> LabelOrder;
+
+// A Data Framework and the book-keeping that goes with it, rather than with one
+// TopoNamingHelper.
+struct TopoNamingState
+{
+	Handle(TDF_Data) DataFramework = new TDF_Data();
+	TDF_Label RootNode = DataFramework->Root();
+	// Where TopoNamingHelper puts its selections, "0:1"
+	TDF_Label SelectionNode;
+	// tag (i.e. "0:2:1:1:3") -> TDF_Label, so LabelFromTag doesn't have to walk the tree
+	// every time
+	std::unordered_map<std::string, TDF_Label> TagToLabel;
+	// Kept up to date by TopoNamingHelper::IndexNamedShape
+	ShapeIndex ShapeToLabels;
+	// Bumped every time a label is added or a NamedShape is written, so anything derived
+	// from the history can tell whether it's stale
+	unsigned long HistoryVersion = 0;
+	// selection label -> the last result of solving it. Only valid while Version matches
+	// HistoryVersion, and only for the same scope and context
+	std::unordered_map<TDF_Label, SolvedSelection, LabelHasher, LabelIsEqual> SolvedSelections;
+	// One TDF_Delta per Track* call that can be undone/redone, oldest first. Deltas only
+	// apply to the Data Framework they were made in, so a new State starts without any.
+	std::deque<Handle(TDF_Delta)> UndoDeltas;
+	std::deque<Handle(TDF_Delta)> RedoDeltas;
+	// Attribute deltas across all of UndoDeltas, a rough measure of the memory they hold
+	size_t UndoAttributeDeltas = 0;
+	// The TagSource of the Root and Selection nodes as the last transaction left them. If
+	// they've moved on since, labels were added outside of a transaction, and the undo
+	// steps can't be trusted any more (see TopoNamingHelper::Undo).
+	int RootTags = 0;
+	int SelectionTags = 0;
+};
+
+// One logical history. Copies of a TopoNamingHelper share one of these, whereas
+// TopoNamingHelper::Fork makes a new one. Forks start out pointing at the same State, and
+// whichever of them writes to it first makes its own copy (see
+// TopoNamingHelper::EnsureUnshared), so State.use_count() > 1 means "shared with a fork".
+struct TopoNamingHistory
+{
+	std::shared_ptr<TopoNamingState> State = std::make_shared<TopoNamingState>();
+	// How many undo steps to keep, and how many attribute deltas they may add up to. See
+	// TopoNamingHelper::SetUndoLimits
+	size_t MaxUndoSteps = 32;
+	size_t MaxUndoAttributeDeltas = 1 << 16;
+};
+#endif /* ifndef TOPO_NAMING_STATE_H */
@@ -0,0 +1,127 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#include <stdexcept>
+
+#include <TopoDS_Iterator.hxx>
+
+#include "TopologyIndex.h"
+#include "GeometricSignature.h"
+#include "ShapeBVH.h"
+
+TopologyIndex::TopologyIndex(const TopoDS_Shape& aShape) : myShape(aShape)
+{
+	if (!aShape.IsNull())
+	{
+		this->AddSubShapes(aShape);
+	}
+}
+
+const TopTools_IndexedMapOfShape& TopologyIndex::Map(const TopAbs_ShapeEnum& aType) const
+{
+	switch (aType)
+	{
+		case TopAbs_FACE:
+			return myFaces;
+		case TopAbs_EDGE:
+			return myEdges;
+		case TopAbs_VERTEX:
+			return myVertices;
+		default:
+			throw std::runtime_error("TopologyIndex only keeps track of Faces, Edges and Vertexes");
+	}
+}
+
+const EdgeSignatureIndex& TopologyIndex::EdgeSignatures() const
+{
+	if (!myEdgeSignatures)
+	{
+		myEdgeSignatures = std::make_shared<const EdgeSignatureIndex>(*this);
+	}
+	return *myEdgeSignatures;
+}
+
+const ShapeBVH& TopologyIndex::FaceBVH() const
+{
+	if (!myFaceBVH)
+	{
+		myFaceBVH = std::make_shared<const ShapeBVH>(myFaces);
+	}
+	return *myFaceBVH;
+}
+
+const ShapeBVH& TopologyIndex::EdgeBVH() const
+{
+	if (!myEdgeBVH)
+	{
+		myEdgeBVH = std::make_shared<const ShapeBVH>(myEdges);
+	}
+	return *myEdgeBVH;
+}
+
+void TopologyIndex::InheritBVHs(const TopologyIndex& Previous) const
+{
+	if (!myFaceBVH && Previous.myFaceBVH)
+	{
+		myFaceBVH = std::make_shared<const ShapeBVH>(myFaces, *Previous.myFaceBVH, Previous.myFaces);
+	}
+	if (!myEdgeBVH && Previous.myEdgeBVH)
+	{
+		myEdgeBVH = std::make_shared<const ShapeBVH>(myEdges, *Previous.myEdgeBVH, Previous.myEdges);
+	}
+}
+
+void TopologyIndex::AddSubShapes(const TopoDS_Shape& aShape)
+{
+	// This is a pre-order depth first walk, which is the same order that TopExp_Explorer
+	// visits things in. That's what keeps the indices identical to TopExp::MapShapes.
+	switch (aShape.ShapeType())
+	{
+		case TopAbs_FACE:
+		{
+			if (myFaces.Contains(aShape))
+			{
+				return;
+			}
+			myFaces.Add(aShape);
+			break;
+		}
+		case TopAbs_EDGE:
+		{
+			// An edge shared by two faces has already had its vertexes added the first
+			// time we ran into it, so no need to go any deeper. Same goes for faces.
+			if (myEdges.Contains(aShape))
+			{
+				return;
+			}
+			myEdges.Add(aShape);
+			break;
+		}
+		case TopAbs_VERTEX:
+		{
+			myVertices.Add(aShape);
+			return;
+		}
+		default:
+			break;
+	}
+
+	TopoDS_Iterator it(aShape);
+	for (; it.More(); it.Next())
+	{
+		this->AddSubShapes(it.Value());
+	}
+}
@@ -0,0 +1,65 @@
+/*********************************************************************************
+*   Copyright (C) 2016 Wolfgang E. Sanyer (ezzieyguywuf@gmail.com)               *
+*                                                                                *
+*   This program is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU General Public License as published by         *
+*   the Free Software Foundation, either version 3 of the License, or            *
+*   (at your option) any later version.                                          *
+*                                                                                *
+*   This program is distributed in the hope that it will be useful,              *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                *
+*   GNU General Public License for more details.                                 *
+*                                                                                *
+*   You should have received a copy of the GNU General Public License            *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+******************************************************************************** */
+#ifndef TOPOLOGY_INDEX_H
+#define TOPOLOGY_INDEX_H
+
+#include <memory>
+
+#include <TopAbs_ShapeEnum.hxx>
+#include <TopoDS_Shape.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+
+class EdgeSignatureIndex;
+class ShapeBVH;
+
+// The Faces, Edges and Vertexes of a single TopoDS_Shape, gathered in one traversal.
+// The indices in each map are the same ones that TopExp::MapShapes would produce, so
+// things like edge ID's used for selection stay the same.
+class TopologyIndex
+{
+public:
+	explicit TopologyIndex(const TopoDS_Shape& aShape);
+
+	const TopoDS_Shape& Shape() const { return myShape; }
+	const TopTools_IndexedMapOfShape& Faces() const { return myFaces; }
+	const TopTools_IndexedMapOfShape& Edges() const { return myEdges; }
+	const TopTools_IndexedMapOfShape& Vertices() const { return myVertices; }
+	// Only TopAbs_FACE, TopAbs_EDGE and TopAbs_VERTEX are indexed
+	const TopTools_IndexedMapOfShape& Map(const TopAbs_ShapeEnum& aType) const;
+	// Geometric signatures of the Edges. Built the first time it's asked for.
+	const EdgeSignatureIndex& EdgeSignatures() const;
+	// Bounding volume hierarchies over the Faces and Edges, built the first time they're
+	// asked for
+	const ShapeBVH& FaceBVH() const;
+	const ShapeBVH& EdgeBVH() const;
+	// Previous is the index of a shape this one was made from. Any hierarchy Previous has
+	// already built is carried over, with only the boxes of the sub-shapes that aren't in
+	// Previous recomputed.
+	void InheritBVHs(const TopologyIndex& Previous) const;
+
+private:
+	void AddSubShapes(const TopoDS_Shape& aShape);
+
+	TopoDS_Shape myShape;
+	TopTools_IndexedMapOfShape myFaces;
+	TopTools_IndexedMapOfShape myEdges;
+	TopTools_IndexedMapOfShape myVertices;
+	mutable std::shared_ptr<const EdgeSignatureIndex> myEdgeSignatures;
+	mutable std::shared_ptr<const ShapeBVH> myFaceBVH;
+	mutable std::shared_ptr<const ShapeBVH> myEdgeBVH;
+};
+#endif /* ifndef TOPOLOGY_INDEX_H */